@@ -0,0 +1,180 @@
+/*
+======================================================================
+
+RSS Power Tool Source Code
+Copyright (C) 2013 Gregory Naughton
+
+This file is part of RSS Power Tool
+
+RSS Power Tool is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+RSS Power Tool is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with RSS Power Tool  If not, see <http://www.gnu.org/licenses/>.
+
+======================================================================
+*/
+
+
+// bloom.cpp
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "bloom.h"
+
+
+#define BLOOM_MAGIC     "rssbloom1"
+
+
+static inline unsigned int hexval( char c )
+{
+    if ( c >= '0' && c <= '9' )
+        return c - '0';
+    if ( c >= 'a' && c <= 'f' )
+        return c - 'a' + 10;
+    if ( c >= 'A' && c <= 'F' )
+        return c - 'A' + 10;
+    return 0;
+}
+
+// a SHA1 is already uniformly distributed; take two 64 bit words from it
+void bloomFilter_t::split( const char * hash, unsigned long long& h1, unsigned long long& h2 )
+{
+    h1 = h2 = 0;
+    unsigned int i = 0;
+    for ( ; i < 16 && hash[i]; i++ )
+        h1 = (h1 << 4) | hexval( hash[i] );
+    for ( ; i < 32 && hash[i]; i++ )
+        h2 = (h2 << 4) | hexval( hash[i] );
+    h2 |= 1; // never 0, or every probe lands on the same bit
+}
+
+bloomFilter_t::~bloomFilter_t()
+{
+    if ( bits )
+        free( bits );
+}
+
+void bloomFilter_t::create( unsigned long expected )
+{
+    if ( bits )
+        free( bits );
+
+    capacity = expected < BLOOM_MIN_CAPACITY ? BLOOM_MIN_CAPACITY : expected;
+    nbits = capacity * BLOOM_BITS_PER_ITEM;
+    bits = (unsigned char *) calloc( (nbits + 7) / 8, 1 );
+    items = 0;
+}
+
+void bloomFilter_t::add( const char * hash )
+{
+    if ( !bits || !hash || !*hash )
+        return;
+
+    unsigned long long h1, h2;
+    split( hash, h1, h2 );
+    for ( unsigned int i = 0; i < BLOOM_HASHES; i++ ) {
+        unsigned long long b = (h1 + i * h2) % nbits;
+        bits[ b >> 3 ] |= 1 << (b & 7);
+    }
+    ++items;
+}
+
+bool bloomFilter_t::maybeHas( const char * hash )
+{
+    if ( !bits )
+        return true; // knows nothing, can't rule anything out
+
+    ++lookups;
+
+    unsigned long long h1, h2;
+    split( hash, h1, h2 );
+    for ( unsigned int i = 0; i < BLOOM_HASHES; i++ ) {
+        unsigned long long b = (h1 + i * h2) % nbits;
+        if ( !(bits[ b >> 3 ] & (1 << (b & 7))) ) {
+            ++negatives;
+            return false;
+        }
+    }
+    return true;
+}
+
+double bloomFilter_t::falsePositiveRate() const
+{
+    unsigned long maybes = lookups - negatives;
+    return maybes ? (double) falsePositives / (double) maybes : 0.0;
+}
+
+struct bloomHeader_t
+{
+    char                magic[ 16 ];
+    unsigned long long  nbits;
+    unsigned long long  capacity;
+    unsigned long long  items;
+    long long           tag1;
+    long long           tag2;
+};
+
+int bloomFilter_t::save( const char * path, long long tag1, long long tag2 ) const
+{
+    if ( !bits )
+        return 0;
+
+    bloomHeader_t h;
+    memset( &h, 0, sizeof(h) );
+    strcpy( h.magic, BLOOM_MAGIC );
+    h.nbits = nbits;
+    h.capacity = capacity;
+    h.items = items;
+    h.tag1 = tag1;
+    h.tag2 = tag2;
+
+    FILE * fp = fopen( path, "wb" );
+    if ( !fp )
+        return 0;
+    int ok = fwrite( &h, sizeof(h), 1, fp ) == 1 && fwrite( bits, (nbits + 7) / 8, 1, fp ) == 1;
+    if ( fclose( fp ) != 0 )
+        ok = 0;
+    if ( !ok )
+        remove( path ); // don't leave half a filter behind
+    return ok;
+}
+
+int bloomFilter_t::load( const char * path, long long tag1, long long tag2 )
+{
+    FILE * fp = fopen( path, "rb" );
+    if ( !fp )
+        return 0;
+
+    bloomHeader_t h;
+    if ( fread( &h, sizeof(h), 1, fp ) != 1 || strncmp( h.magic, BLOOM_MAGIC, sizeof(h.magic) ) != 0
+         || h.tag1 != tag1 || h.tag2 != tag2 || h.nbits == 0 || h.nbits != h.capacity * BLOOM_BITS_PER_ITEM ) {
+        fclose( fp );
+        return 0;
+    }
+
+    unsigned char * b = (unsigned char *) malloc( (h.nbits + 7) / 8 );
+    if ( !b || fread( b, (h.nbits + 7) / 8, 1, fp ) != 1 ) {
+        free( b );
+        fclose( fp );
+        return 0;
+    }
+    fclose( fp );
+
+    if ( bits )
+        free( bits );
+    bits = b;
+    nbits = h.nbits;
+    capacity = h.capacity;
+    items = h.items;
+    return 1;
+}
@@ -0,0 +1,91 @@
+/*
+======================================================================
+
+RSS Power Tool Source Code
+Copyright (C) 2013 Gregory Naughton
+
+This file is part of RSS Power Tool
+
+RSS Power Tool is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+RSS Power Tool is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with RSS Power Tool  If not, see <http://www.gnu.org/licenses/>.
+
+======================================================================
+*/
+
+
+// bloom.h
+#ifndef __BLOOM_H__
+#define __BLOOM_H__
+
+
+#define BLOOM_MIN_CAPACITY      65536
+#define BLOOM_BITS_PER_ITEM     10      // ~1% false positives
+#define BLOOM_HASHES            7
+
+
+/********************************************************
+ *
+ *  bloomFilter_t
+ *
+ *  - remembers a set of SHA1 hex strings (item.hash) in a bit array.
+ *    maybeHas() is never wrong when it says no; when it says yes, the
+ *    caller has to ask the database. Nothing can be removed, so stale
+ *    entries only cost a lookup.
+ *
+ *  - save() / load() keep it in a file, with two numbers from the
+ *    caller that say which state of the database it was built from.
+ *
+ */
+class bloomFilter_t
+{
+protected:
+    unsigned char *     bits;
+    unsigned long       nbits;
+    unsigned long       capacity;   // items it was sized for
+    unsigned long       items;
+
+    static void split( const char * hash, unsigned long long& h1, unsigned long long& h2 );
+
+public:
+
+    // counters for maybeHas(), and the caller's verdicts on its maybes
+    unsigned long       lookups;
+    unsigned long       negatives;
+    unsigned long       falsePositives;
+
+    bloomFilter_t() : bits(0), nbits(0), capacity(0), items(0), lookups(0), negatives(0), falsePositives(0)
+    { }
+    virtual ~bloomFilter_t();
+
+    // empties it, sized for expected items
+    void create( unsigned long expected );
+
+    bool ready() const { return bits != 0; }
+
+    // past capacity the false positive rate climbs; time to rebuild
+    bool full() const { return items > capacity; }
+
+    void add( const char * hash );
+    bool maybeHas( const char * hash );
+
+    // caller found a maybe wasn't there
+    void falsePositive() { ++falsePositives; }
+    double falsePositiveRate() const;
+
+    // 1 on success. load() fails if the file is missing, damaged, or its tags differ
+    int save( const char * path, long long tag1, long long tag2 ) const;
+    int load( const char * path, long long tag1, long long tag2 );
+};
+
+
+#endif /* __BLOOM_H__ */
@@ -280,24 +280,41 @@ unsigned int searchableResult_t::numRows()
     return rows.count();
 }
 
-// re-index rows, filtering by string, case-insenstitive
+// re-index rows, filtering by string, case-insenstitive. A filter that
+//  contains the last one can only match rows that matched it, so only
+//  those are checked again
 void searchableResult_t::updateFilter( basicString_t& filter )
 {
-    rows.reset();
-    res->resetRowCount();
-    basicString_t title;
+    basicString_t f( filter );
+    f.toLower();
 
-    DBRow * row;
-    while ( (row = res->NextRow()) )
+    if ( lastFilter.length() && f.strstr( lastFilter ) )
+    {
+        unsigned int kept = 0;
+        for ( unsigned int i = 0; i < rows.count(); i++ ) {
+            unsigned int j = matched[i];
+            if ( str_find_nocase( titles[j].str, titles[j].len, f.str, f.len ) ) {
+                matched[kept] = j;
+                rows[kept] = rows[i];
+                ++kept;
+            }
+        }
+        rows.truncate( kept );
+        matched.truncate( kept );
+    }
+    else
     {
-        DBValue * v = row->FindByName( "title" );
-        const char *_title = v && v->getString() ? v->getString() : 0;
-        if ( _title ) {
-            title = _title;
-            if ( title.stristr( filter.str ) )
-                rows.push_back( row );        
+        rows.reset();
+        matched.reset();
+        for ( unsigned int j = 0; j < res->numRows(); j++ ) {
+            if ( str_find_nocase( titles[j].str, titles[j].len, f.str, f.len ) ) {
+                rows.push_back( &(*res)[j] );
+                matched.push_back( j );
+            }
         }
     }
+
+    lastFilter = f;
 }
 
 // index rows
@@ -306,14 +323,29 @@ void searchableResult_t::setResult(DBResult* _res)
     // FIXME: handle empty or null results correctly
     Assert ( _res && _res->numRows() && "set to an empty result" );
         
-    rows.reset();
     res = _res;
-    res->resetRowCount();
 
-    DBRow * row;
-    while ( (row = res->NextRow()) )
+    // measure the titles once, here, rather than on every keystroke. The
+    //  search folds case itself, so they point into res as they are
+    titles.reset();
+    int c_title = res->colIndex( "title" );
+    for ( unsigned int j = 0; j < res->numRows(); j++ )
     {
-        rows.push_back( row );        
+        DBValue * v = (*res)[j].column( c_title );
+        titles.push_back( strView_t( v ? v->getString() : 0 ) );
+    }
+
+    matchAll();
+}
+
+void searchableResult_t::matchAll()
+{
+    rows.reset();
+    matched.reset();
+    lastFilter.erase();
+    for ( unsigned int j = 0; j < res->numRows(); j++ ) {
+        rows.push_back( &(*res)[j] );
+        matched.push_back( j );
     }
 }
 
@@ -321,13 +353,7 @@ void searchableResult_t::restoreResult()
 {
     if ( !res )
         return;
-    rows.reset();
-    res->resetRowCount();
-    DBRow * row;
-    while ( (row = res->NextRow()) )
-    {
-        rows.push_back( row );        
-    }
+    matchAll();
 }
 
 /***********************************************************************************************
@@ -873,6 +899,10 @@ void cursesFeedView_t::print_rows()
     int cval = rows_shift & 0x1 ? 3 : 5; // 0b011 | 0b101
 
 
+    int c_id = res->colIndex( "id" );
+    int c_title = res->colIndex( "title" );
+    int c_updated = res->colIndex( "last_updated" );
+
     for ( unsigned int i = rows_shift; i < res->numRows(); i++ )
     {
         // alternate color
@@ -884,11 +914,11 @@ void cursesFeedView_t::print_rows()
 
         // get stuff we want to print
         DBRow & row = (*res)[i]; 
-        DBValue * v = row.FindByName( "id" );
+        DBValue * v = row.column( c_id );
         int feed_id = v ? v->getInt() : 0;
-        v = row.FindByName( "title" );
+        v = row.column( c_title );
         const char * title = v ? v->getString() : 0;
-        v = row.FindByName( "last_updated" );
+        v = row.column( c_updated );
         basicString_t sqldate = v && v->getString() ? v->getString() : 0;
         basicString_t us_date = squish_sqldate_us( sqldate );
 
@@ -2395,13 +2425,12 @@ void cursesMenu_t::_menu_podcasts_f()
     if ( ! podcast_clause.length() )
     {
         const char ** pp = podcast_detection_types;
-        basicString_t buf;
         podcast_clause = "(";
         do
         {  
             if ( pp != podcast_detection_types )
                 podcast_clause += " or";
-            podcast_clause += buf.sprintf( " media_url like '%%%s%%'", *pp );
+            podcast_clause.appendf( " media_url like '%%%s%%'", *pp );
         }
         while ( *++pp );
         podcast_clause += ")";
@@ -309,14 +309,26 @@ class searchableResult_t : public result_t
     DBResult * res;
     cppbuffer_t<DBRow*> rows;
 
+    // parallel to rows: where each is in res
+    cppbuffer_t<unsigned int> matched;
+
+    // title of every row in res, empty if none; made in setResult()
+    cppbuffer_t<strView_t> titles;
+
+    // lowercased; rows holds its matches
+    basicString_t lastFilter;
+
+    void matchAll();
+
 public:
     searchableResult_t() : res(0)
     { }
-    searchableResult_t(DBResult * _r)
+    searchableResult_t(DBResult * _r) : res(0)
     { setResult(_r); }
 
     virtual DBRow & operator[] ( unsigned int );
     virtual unsigned int numRows();
+    virtual int colIndex( strView_t n ) { return res ? res->colIndex( n ) : -1; }
 
     void updateFilter( basicString_t& );
     void setResult(DBResult* _res);
@@ -27,6 +27,8 @@ along with RSS Power Tool  If not, see <http://www.gnu.org/licenses/>.
 
 #include <string.h>
 #include <stdlib.h> // malloc
+#include <sched.h>  // sched_yield
+#include <time.h>   // nanosleep
 
 // Assert
 void _hidden_Assert( int, const char *, const char *, int );
@@ -45,11 +47,17 @@ void _hidden_Assert( int, const char *, const char *, int );
 
         1 poolPage_t is allocated ahead of time; more added if the list uses them.
         Items can be returned to the pool and used again at a very fast speed.
+        A pool can be owned by one thread and still take returns from others.
 
     vec_t: simple resizing array, good for repetitive work on sets of unknown size
 
     buffer_t: primitive, fast, automatically-growing data array 
 
+    boundedQueue_t: fixed size, lock-free queue for handing work between threads
+
+    arena_t: bump allocator; hands out memory from a few large blocks and
+        gives it all back at once
+
 ------------------------------------------------------------------------------
 */
 
@@ -64,6 +72,23 @@ static volatile const int DefPoolPageSize = 1024;
 volatile static const unsigned int BUFFER_DEFAULT_SIZE = 2048;
 */
 
+template <typename type> struct memPool_t;
+
+/*
+======================================
+    poolSlot_t
+======================================
+*/
+// one object and the bookkeeping to give it back. The object comes first,
+//  so a pointer to it is also a pointer to its slot
+template <typename type>
+struct poolSlot_t
+{
+    type obj;
+    poolSlot_t<type> *nextFree;     // while it's on a free list
+    memPool_t<type> *pool;          // the pool it came from
+};
+
 /*
 ======================================
     poolPage_t
@@ -73,19 +98,16 @@ template <typename type>
 struct poolPage_t
 {
     int pageSize;
-    int inuse;                  // count how many used
-    type *page;
-    int returnEnd;              // last good index into returnList
-    int returnStart;            // first good index into returnList
+    int inuse;                  // count how many handed out from the top; returns go to the pool's free list
+    poolSlot_t<type> *page;
     poolPage_t<type> *next, *prev;
-    unsigned int *returnList;
 
-    // init is basic O(1). for use only on a page's initialization/1st use
-    // dont alloc returnList until we need it
-    poolPage_t( int sz =DEF_POOL_PAGE_SIZE ) : next(0), prev(0), returnList(0)
+    poolPage_t( int sz, memPool_t<type> * owner ) : next(0), prev(0)
     {
         pageSize = sz;
-        page = new type[ pageSize ];
+        page = new poolSlot_t<type>[ pageSize ];
+        for ( int i = 0; i < pageSize; i++ )
+            page[i].pool = owner;
         reset();
     }
 
@@ -93,64 +115,21 @@ struct poolPage_t
     {
         if ( page )
             delete[] page;
-        if ( returnList )
-            delete[] returnList;
     }
 
     //  O(1) 
     void reset( void ) 
     {
-        returnEnd = returnStart = -1;
         inuse = 0;
     }
 
     void erase( void ) 
     {
-        memset( page, 0, sizeof(type) * pageSize );
-        reset();
-    }
-
-    void returnOne( unsigned int n ) 
-    {
-        // none returned at all
-        if ( returnEnd == -1 ) {
-            returnEnd = returnStart = 0;
-            if ( !returnList )
-                returnList = new unsigned int[ pageSize ];
-            returnList[0] = n;
-            return;
-        }
-
-        int i = (returnEnd + 1) % pageSize;
-
-        // haven't hit returnStart, tack return onto End
-        if ( i != returnStart ) {
-            returnList[i] = n;
-            returnEnd = i;
-            return;
-        }
-
-        // returnEnd == returnStart, the returns rolled over,
-        //  the entire list is free 
+        for ( int i = 0; i < pageSize; i++ )
+            memset( &page[i].obj, 0, sizeof(type) );
         reset();
     }
 
-    // all are in use in memPool; see if there are any in returnList that we can use.
-    int checkForReturned( void ) {
-        if ( returnStart != -1 ) {
-            // one open slot left in returnList
-            if ( returnStart == returnEnd ) {
-                int n = returnStart;
-                returnStart = returnEnd = -1;
-                return returnList[n];
-            }
-            int ind = returnStart;
-            returnStart = (returnStart+1) % pageSize;
-            return returnList[ ind ];
-        }
-        return -1;
-    }
-
 }; // memPage_t
 
 
@@ -158,37 +137,57 @@ struct poolPage_t
 /*
 ======================================
  memPool_t
+
+ - getone() and returnone() are O(1). Returned objects go on a free list,
+   threaded through their slots, and are handed out again before any
+   fresh ones.
+
+ - shared between threads only in owner mode: after setOwnerThread(), the
+   calling thread is the only one that may getone(). Any thread may
+   returnone(); from the others, the object is pushed onto a lock-free
+   stack, which the owner takes over in one go when its free list runs dry.
+   An object can be returned to any pool; it always goes home to the
+   one it came from
 ======================================
 */
 template <typename type>
 struct memPool_t 
 {
-    poolPage_t<type> * page;
-    unsigned int pageIndex;  // index of the current page 
+    typedef poolSlot_t<type> slot_t;
+
+    poolPage_t<type> * page;        // first page
+    poolPage_t<type> * current;     // page being handed out from
     unsigned int numPages;
     unsigned int CreatedBaseSize;
     unsigned int currentPageSize;
 
-    memPool_t() : pageIndex(0), numPages(1)
+    slot_t * freeList;              // returned, owner thread only
+    slot_t * remote;                // returned from other threads
+    const void * owner;             // owning thread, in owner mode; else 0
+
+    // distinct for every thread
+    static const void * threadTag()
+    {
+        static __thread char tag;
+        return &tag;
+    }
+
+    memPool_t() : numPages(1), freeList(0), remote(0), owner(0)
     {
         CreatedBaseSize = DEF_POOL_PAGE_SIZE;
         currentPageSize = CreatedBaseSize;
-        page = new poolPage_t<type>( currentPageSize );
+        current = page = new poolPage_t<type>( currentPageSize, this );
     }
 
-    memPool_t( unsigned int sz ) : pageIndex(0), numPages(1)
+    memPool_t( unsigned int sz ) : numPages(1), freeList(0), remote(0), owner(0)
     {
         // pages double in size, first one starts at DEF_POOL_PAGE_SIZE or what
         //  was requested. on reset this goes back to CreatedBaseSize
-        CreatedBaseSize = sz;
-        currentPageSize = CreatedBaseSize;
-        page = new poolPage_t<type>( currentPageSize );
-
-        // reset only first page.  if there are other pages, they are
-        //  reset when they become the current page again
         // note: a page's size is only determined when it is first created,
         //  afterwards the size argument is ignored
-        //page.reset( currentPageSize );
+        CreatedBaseSize = sz;
+        currentPageSize = CreatedBaseSize;
+        current = page = new poolPage_t<type>( currentPageSize, this );
     }
 
     ~memPool_t()
@@ -197,108 +196,92 @@ struct memPool_t
         delete page;
     }
 
+    // only this thread takes objects out; see above
+    void setOwnerThread() { owner = threadTag(); }
+
+    // everything is free again; pages are kept for reuse
     void reset() {
         currentPageSize = CreatedBaseSize;
-        pageIndex = 0;
+        current = page;
         page->reset();
+        freeList = 0;
+        __atomic_store_n( &remote, (slot_t *) 0, __ATOMIC_RELAXED );
     }
 
     // completely wipes out and resets whole pool
     void clear()
     {
-        poolPage_t<type> *p = page;
-        while ( p->next ) {
-            p = p->next;
-            p->prev->erase();
-        }
-        p->erase();
+        for ( poolPage_t<type> *p = page; p; p = p->next )
+            p->erase();
+        reset();
     }
 
 
     poolPage_t<type> * newpage( void ) 
     {
-        // get current page
-        poolPage_t<type> *p = getPage( pageIndex );
+        poolPage_t<type> *p = current;
 
         // if we're at the end of our pages...  create another page
-        if ( pageIndex == numPages - 1 ) 
+        if ( !p->next ) 
         {
             // heuristic: each new page is twice the size of the last
             if ( currentPageSize < MAX_PAGE_SIZE ) 
                 currentPageSize *= 2;
 
-            p->next = new poolPage_t<type>( currentPageSize );
+            p->next = new poolPage_t<type>( currentPageSize, this );
+            p->next->prev = p;
             ++numPages;
         } 
         else 
-        // get the pagesize from a page we already created
+        // get the pagesize from a page we already created, and reset it
         {
-            if ( p->next )
-                currentPageSize = p->next->pageSize;
-        }
-
-        // this step serves to initialize a page, if it was created in the
-        //  step above, it also resets pages that we have already allocated
-        ++pageIndex;
-
-        if ( p->next ) {
+            currentPageSize = p->next->pageSize;
             p->next->reset();
-            p->next->prev = p;
         }
 
-        return p->next;
+        current = p->next;
+        return current;
     }
 
     //
     type *getone ( void ) 
     {
-        poolPage_t<type> *p;
+        slot_t * s = freeList;
 
-        // check we are not off the end of the poolPage_t
-        if ( !( p = getPage( pageIndex ) ) )
-            return 0;
-        if ( p->pageSize == p->inuse ) {
-            // see if there were any returned that we can reuse them
-            int i = p->checkForReturned();
-            if ( i > -1 )
-                return &p->page[i];
-            // entire page in use, get new one
-            p = newpage();
+        // take over whatever other threads gave back
+        if ( !s && __atomic_load_n( &remote, __ATOMIC_RELAXED ) )
+            s = __atomic_exchange_n( &remote, (slot_t *) 0, __ATOMIC_ACQUIRE );
+
+        if ( s ) {
+            freeList = s->nextFree;
+            return &s->obj;
         }
 
-        ++p->inuse;
-        return &p->page[p->inuse-1];
+        poolPage_t<type> *p = current;
+        if ( p->pageSize == p->inuse ) 
+            p = newpage();
+
+        return &p->page[ p->inuse++ ].obj;
     }
 
     void returnone( type *ret ) {
-        // find which page
-        poolPage_t<type> *p = page;
-        while ( 1 ) {
-            int diff; 
-            if ( (diff = (int)(ret - p->page)) < p->pageSize ) {
-                p->returnOne( diff ) ;
-                return;
-            }
-            // hit the end and didn't find it
-            if ( !p->next )
-                return;
-            p = p->next;
+        if ( !ret )
+            return;
+
+        slot_t * s = reinterpret_cast<slot_t *>( ret );
+        memPool_t<type> * home = s->pool;
+
+        if ( !home->owner || home->owner == threadTag() ) {
+            s->nextFree = home->freeList;
+            home->freeList = s;
+            return;
         }
-    }
 
-    poolPage_t<type> * getPage( unsigned int n ) 
-    {
-        poolPage_t<type> *p = page;
-        if ( n == 0 ) 
-            return page;
-        
+        // from another thread
+        slot_t * top = __atomic_load_n( &home->remote, __ATOMIC_RELAXED );
         do {
-            p = p->next;
-            if ( ! p )
-                return 0;
-        } while ( --n != 0 );
-
-        return p;
+            s->nextFree = top;
+        } while ( !__atomic_compare_exchange_n( &home->remote, &top, s, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED ) );
     }
 
     // relinquishes all pages except the base page
@@ -310,9 +293,9 @@ struct memPool_t
             tmp = p->next;
             delete p;
         }
+        page->next = 0;
         numPages = 1;
-        pageIndex = 0;
-        currentPageSize = CreatedBaseSize;
+        reset();
     }
 
 }; // memPool_t
@@ -924,6 +907,14 @@ public:
         return data[ length() - 1 ];
     }
 
+    // remove last elt and return it
+    type pop( void )
+    {
+        if ( free_p == data )
+            return type();
+        return *--free_p;
+    }
+
     void removeIndex( unsigned int index ) {
         if ( !data || index >= length() || length() == 0 )
             return;
@@ -973,6 +964,9 @@ public:
 
     - Starts with 1 page. Pages are static size, but can be set to custom value at initialization.
     - if access off the end of the array occurs, additional pages will be allocated automatically
+    - pages are kept in a directory, by number, so finding an element is a divide
+        and a lookup, however far into the array it is. The directory doubles when
+        it fills; pages themselves never move, so references to elements stay good
     - internal counter exists marking highest array elt, for use with .push_back() style method
         can also double as size() or lenth() style call, even though it is not a direct indicator of
         how much memory is currently alloc'd.  For that call: sizeAllocated()
@@ -990,18 +984,17 @@ protected:
     struct page_t 
     {
         type * data;
-        page_t * next;
-        unsigned int size;
-        page_t() : data(0),next(0),size(0) { 
+        page_t() : data(0) { 
             data = new type[ Bufsz ];
-            size = Bufsz;
         }
         ~page_t() {
             delete[] data;
         }
     } ;
 
-    page_t * basepage;
+    page_t ** pages;        // directory, by page number
+    unsigned int npages;    // allocated
+    unsigned int dirSize;   // slots in the directory
 
     // will automatically index the size of the array by marking
     //  the highest index referenced
@@ -1017,28 +1010,42 @@ protected:
             lastInsert = insert_index;
     }
 
+    // allocate pages up to and including page p
+    void grow( unsigned int p )
+    {
+        if ( p >= dirSize ) {
+            unsigned int sz = dirSize * 2;
+            while ( sz <= p )
+                sz *= 2;
+            page_t ** dir = new page_t*[ sz ];
+            memcpy( dir, pages, npages * sizeof(page_t*) );
+            delete[] pages;
+            pages = dir;
+            dirSize = sz;
+        }
+        while ( npages <= p )
+            pages[ npages++ ] = new page_t;
+    }
+
+    // not copyable
+    cppbuffer_t( const cppbuffer_t& );
+    cppbuffer_t& operator=( const cppbuffer_t& );
+
 public:
     // looking for individual element, find page it's on, return element
     type& operator[]( unsigned int index ) 
     {
-        page_t * p = basepage;
-        int accum = 0;
-        
-        // looking for page
-        while ( index >= p->size + accum ) {
-            // got here, which means we didn't find it. try next page
-            if ( !p->next ) {
-                // no next page, make one
-                p->next = new page_t;
-            }
-            accum += p->size;
-            p = p->next;
+        unsigned int p = index / Bufsz;
+
+        if ( p >= npages ) {
+            // no page there yet, make it
+            grow( p );
         }
 
         // record higher index accesses
         updateLastInsert( index );
 
-        return p->data[ index - accum ];
+        return pages[ p ]->data[ index % Bufsz ];
     }
 
     /**
@@ -1063,31 +1070,22 @@ public:
         return push_back( ref );
     }
 
-    cppbuffer_t() : lastInsert(((unsigned)-1))
+    cppbuffer_t() : pages(0), npages(0), dirSize(4), lastInsert(((unsigned)-1))
     {
-        basepage = new page_t;
+        pages = new page_t*[ dirSize ];
+        pages[ npages++ ] = new page_t;
     }
 
     virtual ~cppbuffer_t( void ) 
     {
-        page_t * p = basepage->next;
-        while ( p ) {
-            page_t * next = p->next;
-            delete p;
-            p = next;
-        }
-        delete basepage;
+        for ( unsigned int i = 0; i < npages; i++ )
+            delete pages[i];
+        delete[] pages;
     }
 
     unsigned int num_pages()
     { 
-        page_t * p = basepage;
-        unsigned int i = 0;
-        while ( p ) {
-            ++i;
-            p = p->next;
-        }
-        return i;
+        return npages;
     }
 
     unsigned int sizeAllocated()
@@ -1100,6 +1098,245 @@ public:
     unsigned int count() { return lastInsert + 1; }
     unsigned int length() { return lastInsert + 1; }
     void reset() { lastInsert = (unsigned)-1; }
+    // keep only the first n
+    void truncate( unsigned int n ) { if ( n < size() ) lastInsert = n - 1; }
 }; // cppbuffer_t
 
+
+
+/*
+=============================================================================
+
+    boundedQueue_t
+
+    fixed capacity ring for passing primitives (usually pointers) between
+    threads. Any number of threads may push and pop at once; there are no
+    locks. Each cell carries a sequence number saying whether it is ready to
+    be written or read, so a producer and consumer only ever contend on the
+    head or tail counter. (Dmitry Vyukov's bounded MPMC queue)
+
+    push() and pop() never block; they return false when full or empty.
+    pushWait() and popWait() back off until they succeed.
+
+=============================================================================
+*/
+template <typename type>
+class boundedQueue_t
+{
+protected:
+    struct cell_t {
+        unsigned long   seq;
+        type            data;
+    };
+
+    cell_t *            cells;
+    unsigned long       mask;
+
+    // keep producers and consumers off each other's cache line
+    char                pad0[ 64 ];
+    unsigned long       tail;       // next push
+    char                pad1[ 64 ];
+    unsigned long       head;       // next pop
+    char                pad2[ 64 ];
+
+    static void backoff( unsigned int& spins )
+    {
+        if ( ++spins < 64 ) {
+            sched_yield();
+            return;
+        }
+        struct timespec ts = { 0, 200000 }; // .2ms
+        nanosleep( &ts, 0 );
+    }
+
+public:
+
+    // capacity is rounded up to a power of 2
+    boundedQueue_t( unsigned int sz =64 ) : tail(0), head(0)
+    {
+        unsigned long n = 2;
+        while ( n < sz )
+            n <<= 1;
+        mask = n - 1;
+        cells = new cell_t[ n ];
+        for ( unsigned long i = 0; i < n; i++ )
+            cells[i].seq = i;
+    }
+
+    ~boundedQueue_t()
+    {
+        delete[] cells;
+    }
+
+    bool push( type v )
+    {
+        cell_t * c;
+        unsigned long pos = __atomic_load_n( &tail, __ATOMIC_RELAXED );
+        for ( ;; )
+        {
+            c = &cells[ pos & mask ];
+            unsigned long seq = __atomic_load_n( &c->seq, __ATOMIC_ACQUIRE );
+            long dif = (long) seq - (long) pos;
+            if ( dif == 0 ) {
+                if ( __atomic_compare_exchange_n( &tail, &pos, pos + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED ) )
+                    break;
+            }
+            else if ( dif < 0 )
+                return false; // full
+            else
+                pos = __atomic_load_n( &tail, __ATOMIC_RELAXED );
+        }
+        c->data = v;
+        __atomic_store_n( &c->seq, pos + 1, __ATOMIC_RELEASE );
+        return true;
+    }
+
+    bool pop( type& v )
+    {
+        cell_t * c;
+        unsigned long pos = __atomic_load_n( &head, __ATOMIC_RELAXED );
+        for ( ;; )
+        {
+            c = &cells[ pos & mask ];
+            unsigned long seq = __atomic_load_n( &c->seq, __ATOMIC_ACQUIRE );
+            long dif = (long) seq - (long) (pos + 1);
+            if ( dif == 0 ) {
+                if ( __atomic_compare_exchange_n( &head, &pos, pos + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED ) )
+                    break;
+            }
+            else if ( dif < 0 )
+                return false; // empty
+            else
+                pos = __atomic_load_n( &head, __ATOMIC_RELAXED );
+        }
+        v = c->data;
+        __atomic_store_n( &c->seq, pos + mask + 1, __ATOMIC_RELEASE );
+        return true;
+    }
+
+    void pushWait( type v )
+    {
+        unsigned int spins = 0;
+        while ( !push( v ) )
+            backoff( spins );
+    }
+
+    type popWait()
+    {
+        type v;
+        unsigned int spins = 0;
+        while ( !pop( v ) )
+            backoff( spins );
+        return v;
+    }
+
+    unsigned int capacity() const { return (unsigned int) mask + 1; }
+}; // boundedQueue_t
+
+
+/*
+==============================================================================
+
+    arena_t
+
+    - allocations are carved off the end of the current block, and a new
+      block, twice the size of the last, is started when one fills up.
+      Nothing is freed singly; reset() and the dtor free every block.
+      Objects placed in it need their destructors called by the owner.
+
+==============================================================================
+*/
+#define ARENA_DEFAULT_SIZE  (8*1024)
+#define ARENA_ALIGN         16
+
+class arena_t
+{
+protected:
+    struct block_t {
+        block_t *   next;
+        size_t      size;
+        size_t      used;
+        // aligned so the data after the header is aligned too
+        char        pad[ ARENA_ALIGN - (sizeof(void*) + 2*sizeof(size_t)) % ARENA_ALIGN ];
+        char *      data() { return (char *)( this + 1 ); }
+    };
+
+    block_t *       head;       // current block; older ones follow
+    size_t          firstSize;
+    size_t          nextSize;
+    unsigned int    nblocks;
+
+    // not copyable
+    arena_t( const arena_t& );
+    arena_t& operator=( const arena_t& );
+
+    void * newBlock( size_t sz )
+    {
+        // a request bigger than a block gets one of its own, and the
+        //  current block stays current
+        bool big = sz > nextSize;
+        size_t bsz = big ? sz : nextSize;
+
+        block_t * b = (block_t *) malloc( sizeof(block_t) + bsz );
+        b->size = bsz;
+        b->used = sz;
+
+        if ( big && head ) {
+            b->next = head->next;
+            head->next = b;
+        } else {
+            b->next = head;
+            head = b;
+            if ( !big && nextSize < MAX_PAGE_SIZE )
+                nextSize *= 2;
+        }
+        ++nblocks;
+        return b->data();
+    }
+
+public:
+    arena_t( size_t sz =ARENA_DEFAULT_SIZE ) : head(0), firstSize(sz), nextSize(sz), nblocks(0)
+    { }
+
+    ~arena_t() { reset(); }
+
+    // ARENA_ALIGN aligned; never 0
+    void * alloc( size_t sz )
+    {
+        sz = ( sz + ARENA_ALIGN - 1 ) & ~(size_t)( ARENA_ALIGN - 1 );
+        if ( !sz )
+            sz = ARENA_ALIGN;
+        if ( head && head->size - head->used >= sz ) {
+            void * p = head->data() + head->used;
+            head->used += sz;
+            return p;
+        }
+        return newBlock( sz );
+    }
+
+    // copy of n bytes of s, with a terminator
+    char * strndup( const char * s, size_t n )
+    {
+        char * p = (char *) alloc( n + 1 );
+        memcpy( p, s, n );
+        p[ n ] = '\0';
+        return p;
+    }
+
+    // hands back every block
+    void reset()
+    {
+        block_t * tmp;
+        for ( block_t * b = head; b; b = tmp ) {
+            tmp = b->next;
+            free( b );
+        }
+        head = 0;
+        nextSize = firstSize;
+        nblocks = 0;
+    }
+
+    unsigned int blocks() const { return nblocks; }
+}; // arena_t
+
 #endif // ! __DATATYPES_H__
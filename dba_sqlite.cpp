@@ -26,8 +26,11 @@ along with RSS Power Tool  If not, see <http://www.gnu.org/licenses/>.
 
 #include <stdio.h>
 #include <string.h>
+#include <strings.h>
 #include <stdarg.h>
 #include <stdlib.h>
+#include <ctype.h>
+#include <new>      // placement new
 
 
 #include "dba_sqlite.h"
@@ -77,60 +80,169 @@ const char * sqlite_error_string( int c )
  *
  ********************************************************************/
 
-DBValue::DBValue( int i ) : ival(0),fval(0),sval(),_name(0)
+DBValue::DBValue( int i ) : _type(SQLITE_NULL), text(0), textLen(0), ownText(false), _name(0)
 {
-    setInt( i );
+    setInt64( i );
 }
 
-DBValue::DBValue( double f ) : ival(0),fval(0),sval(),_name(0)
+DBValue::DBValue( double f ) : _type(SQLITE_NULL), text(0), textLen(0), ownText(false), _name(0)
 {
     setFloat( f );
 }
 
-DBValue::DBValue( const char * str ) : ival(0),fval(0),sval(),_name(0)
+DBValue::DBValue( const char * str ) : _type(SQLITE_NULL), text(0), textLen(0), ownText(false), _name(0)
 {
+    num.i = 0;
     setString( str );
 }
 
-void DBValue::setInt( int i )
+void DBValue::freeText() const
 {
-    ival = i;
+    if ( ownText )
+        free( text );
+    text = 0;
+    textLen = 0;
+    ownText = false;
+}
 
-    char buf[50];
-    memset(buf,0,50);
-    snprintf( buf, 50, "%i", i );
-    sval.strncpy( buf, 50 );
+void DBValue::setText( const char * s, unsigned int len ) const
+{
+    freeText();
+    ownText = len >= sizeof(small);
+    text = ownText ? (char *) malloc( len + 1 ) : small;
+    memcpy( text, s, len );
+    text[ len ] = '\0';
+    textLen = len;
+}
 
-    fval = (double) ival;
+void DBValue::setInt64( long long i )
+{
+    freeText();
+    _type = SQLITE_INTEGER;
+    num.i = i;
 }
 
 void DBValue::setFloat( double f )
 {
-    ival = (int) f;
+    freeText();
+    _type = SQLITE_FLOAT;
+    num.f = f;
+}
 
-    char buf[50];
-    memset(buf,0,50);
-    snprintf( buf, 50, "%f", f );
-    sval.strncpy( buf, 50 );
+void DBValue::setString( const char * str )
+{
+    // stop these "(null)" strings from propagating
+    if ( !str || !*str || strcmp( "(null)", str ) == 0 )
+        return setNull();
+    _type = SQLITE_TEXT;
+    num.i = 0;
+    setText( str, strlen( str ) );
+}
 
-    fval = f;
+void DBValue::setNull()
+{
+    freeText();
+    _type = SQLITE_NULL;
+    num.i = 0;
 }
 
-void DBValue::setString( const char * str )
+void DBValue::setColumn( sqlite3_stmt * s, int col, arena_t * arena )
 {
-    if ( !str || !*str ) {
-        sval.erase();
-        ival = 0;
-        fval = 0.0;
-        return;
+    switch ( sqlite3_column_type( s, col ) )
+    {
+    case SQLITE_INTEGER:
+        setInt64( sqlite3_column_int64( s, col ) );
+        break;
+    case SQLITE_FLOAT:
+        setFloat( sqlite3_column_double( s, col ) );
+        break;
+    case SQLITE_TEXT:
+    case SQLITE_BLOB:
+    {
+        const char * p = (const char *) sqlite3_column_text( s, col );
+        int n = sqlite3_column_bytes( s, col );
+        if ( !p || n == 0 || strcmp( "(null)", p ) == 0 ) {
+            setNull();
+            break;
+        }
+        if ( arena && n >= (int) sizeof(small) ) {
+            freeText();
+            text = arena->strndup( p, n );
+            textLen = n;
+        } else {
+            setText( p, n );
+        }
+        _type = SQLITE_TEXT;
+        num.i = 0;
+        break;
+    }
+    default:
+        setNull();
+        break;
     }
-    sval = str;
-    ival = atoi( str );
-    fval = atof( str );
 }
 
-DBValue::~DBValue() 
-{ }
+void DBValue::take( DBValue& v )
+{
+    freeText();
+    _type = v._type;
+    num = v.num;
+    _name = v._name;
+    if ( v.text == v.small ) {
+        memcpy( small, v.small, sizeof(small) );
+        text = small;
+    } else {
+        text = v.text;
+    }
+    textLen = v.textLen;
+    ownText = v.ownText;
+    v.text = 0;
+    v.textLen = 0;
+    v.ownText = false;
+    v._type = SQLITE_NULL;
+}
+
+long long DBValue::getInt64() const
+{
+    switch ( _type ) {
+    case SQLITE_INTEGER: return num.i;
+    case SQLITE_FLOAT: return (long long) num.f;
+    case SQLITE_TEXT: return atoll( text );
+    }
+    return 0;
+}
+
+double DBValue::getFloat() const
+{
+    switch ( _type ) {
+    case SQLITE_INTEGER: return (double) num.i;
+    case SQLITE_FLOAT: return num.f;
+    case SQLITE_TEXT: return atof( text );
+    }
+    return 0.0;
+}
+
+const char * DBValue::getString() const
+{
+    if ( text || _type == SQLITE_NULL )
+        return text;
+
+    // numbers are written out the first time, the way sqlite writes them
+    char buf[ 32 ];
+    int n;
+    if ( _type == SQLITE_INTEGER ) {
+        n = snprintf( buf, sizeof(buf), "%lld", num.i );
+    } else {
+        n = snprintf( buf, sizeof(buf), "%.15g", num.f );
+        if ( !strpbrk( buf, ".eni" ) && n < (int) sizeof(buf) - 2 ) {
+            buf[ n++ ] = '.';
+            buf[ n++ ] = '0';
+            buf[ n ] = '\0';
+        }
+    }
+    setText( buf, n );
+    return text;
+}
 
 
 
@@ -142,83 +254,102 @@ DBValue::~DBValue()
 
 DBRow::~DBRow() 
 { 
-    for ( unsigned int i = 0 ; i < values.count(); i++ ) {
-        delete values[i];
+    if ( !arena ) {
+        delete[] values;
+        return;
     }
-    values.reset(); // resets the push_back counter
+    // the arena frees the memory
+    for ( unsigned int i = 0; i < cap; i++ )
+        values[i].~DBValue();
 }
 
-void DBRow::addVal( const char * str ) 
+DBValue * DBRow::newValues( unsigned int n )
 {
-    DBValue * v = new DBValue( str );
-    values.push_back( v );
+    if ( !n )
+        return 0;
+    if ( !arena )
+        return new DBValue[ n ];
+
+    DBValue * v = (DBValue *) arena->alloc( n * sizeof(DBValue) );
+    for ( unsigned int i = 0; i < n; i++ )
+        new ( &v[i] ) DBValue;
+    return v;
 }
 
-DBValue & DBRow::operator[]( unsigned int ind ) 
+DBValue & DBRow::next()
 {
-    if ( ind >= values.size() && ind < values.size() )
-        return *values[0];
+    if ( ncols == cap )
+    {
+        unsigned int grownCap = cap ? cap * 2 : 8;
+        DBValue * grown = newValues( grownCap );
+        for ( unsigned int i = 0; i < ncols; i++ )
+            grown[i].take( values[i] );
+        if ( arena ) {
+            for ( unsigned int i = 0; i < cap; i++ )
+                values[i].~DBValue();
+        } else {
+            delete[] values;
+        }
+        values = grown;
+        cap = grownCap;
+    }
+    return values[ ncols++ ];
+}
 
-    return *values[ind];
+void DBRow::addVal( const char * str ) 
+{
+    next().setString( str );
 }
 
-DBValue * DBRow::FindByName( const char * colname )
+DBValue & DBRow::operator[]( unsigned int ind ) 
 {
-    if ( !colname || !*colname )
-        return 0;
+    if ( ind >= ncols && ncols > 0 )
+        return values[0];
 
-    basicString_t tester( colname );
+    return values[ind];
+}
 
-    return FindByName( tester );
+// case-insensitive; name is null-terminated, v needn't be
+static bool colNameIs( const char * name, strView_t v )
+{
+    return strncasecmp( name, v.str, v.len ) == 0 && name[ v.len ] == '\0';
 }
 
-DBValue * DBRow::FindByName( const basicString_t& col )
+DBValue * DBRow::FindByName( strView_t colname )
 {
     // not matching empty names
-    if ( col.length() == 0 )
+    if ( colname.empty() )
         return 0;
 
-    for ( unsigned int i = 0 ; i < values.count(); i++ ) {
-        const char * _name = values[i]->name();
+    if ( owner )
+        return column( owner->colIndex( colname ) );
+
+    for ( unsigned int i = 0 ; i < ncols; i++ ) {
+        const char * _name = values[i].name();
         if ( !_name )
             return 0;
-        if ( col.icompare( _name ) )
-            return values[i];
+        if ( colNameIs( _name, colname ) )
+            return &values[i];
     }
     return 0;
 }
 
 const char * DBRow::getString( const char * col )
 {
-    if ( !col || !*col )
-        return 0;
-    basicString_t tester( col );
-    DBValue * v = FindByName( tester );
-    if ( !v || !v->getString() )
-        return 0;
-    return v->getString();
+    DBValue * v = FindByName( col );
+    return v ? v->getString() : 0;
 }
 
 int DBRow::getInt( const char * col )
 {
-    if ( !col || !*col )
-        return 0;
-    basicString_t tester( col );
-    DBValue * v = FindByName( tester );
-    if ( !v )
-        return 0;
-    return v->getInt();
+    DBValue * v = FindByName( col );
+    return v ? v->getInt() : 0;
 }
 
 double DBRow::getFloat( const char * col )
 {
-    if ( !col || !*col )
-        return 0.0;
-    basicString_t tester( col );
-    DBValue * v = FindByName( tester );
-    if ( !v )
-        return 0;
-    return v->getFloat();
+    DBValue * v = FindByName( col );
+    return v ? v->getFloat() : 0.0;
 }
 
 
@@ -254,10 +385,62 @@ DBRow * DBResult::NextRow()
     return rows[nextCount];
 }
 
+DBRow * DBResult::newRow( int num, unsigned int cols )
+{
+    DBRow * row = new ( arena.alloc( sizeof(DBRow) ) ) DBRow( num, cols, &arena );
+    rows.push_back( row );
+    return row;
+}
+
 void DBResult::addColName ( const char * c_str )
 {
-    basicString_t * str_p = new basicString_t( c_str );
-    col_names.push_back( str_p );
+    col_names.push_back( arena.strndup( c_str, strlen( c_str ) ) );
+}
+
+static unsigned int colHash( const char * s, unsigned int n )
+{
+    unsigned int h = 2166136261u;
+    for ( const char * e = s + n; s < e; s++ )
+        h = (h ^ (unsigned char) tolower( *s )) * 16777619u;
+    return h;
+}
+
+void DBResult::buildColMap()
+{
+    unsigned int n = 8;
+    while ( n < col_names.size() * 2 )
+        n <<= 1;
+    colMap = (int *) calloc( n, sizeof(int) );
+    colMapMask = n - 1;
+
+    for ( unsigned int i = 0; i < col_names.size(); i++ )
+    {
+        unsigned int slot = colHash( col_names[i], strlen( col_names[i] ) ) & colMapMask;
+        while ( colMap[ slot ] ) {
+            // first of duplicate names wins, as with a scan
+            if ( strcasecmp( col_names[ colMap[slot] - 1 ], col_names[i] ) == 0 )
+                break;
+            slot = (slot + 1) & colMapMask;
+        }
+        if ( !colMap[ slot ] )
+            colMap[ slot ] = i + 1;
+    }
+}
+
+int DBResult::colIndex( strView_t name )
+{
+    if ( name.empty() || col_names.size() == 0 )
+        return -1;
+    if ( !colMap )
+        buildColMap();
+
+    unsigned int slot = colHash( name.str, name.len ) & colMapMask;
+    while ( colMap[ slot ] ) {
+        if ( colNameIs( col_names[ colMap[slot] - 1 ], name ) )
+            return colMap[ slot ] - 1;
+        slot = (slot + 1) & colMapMask;
+    }
+    return -1;
 }
 
 const char * DBResult::colName( unsigned int j ) 
@@ -265,7 +448,7 @@ const char * DBResult::colName( unsigned int j )
     if ( j >= col_names.size() || col_names.size() == 0 )
         return 0;
 
-    return const_cast<const char *>( col_names[j]->str );
+    return col_names[j];
 }
 
 
@@ -276,15 +459,18 @@ void DBResult::eraseAndReset()
     if ( _statementType == STMT_NONE )
         return;
 
+    // rows were placed in the arena; only their dtors need calling
     for ( unsigned int i = 0; i < rows.count(); i++ ) {
-        delete rows[i];
+        rows[i]->~DBRow();
     }
     rows.reset();
-
-    for ( unsigned int i = 0; i < col_names.count(); i++ ) {
-        delete col_names[i];
-    }
     col_names.reset();
+    arena.reset();
+
+    if ( colMap )
+        free( colMap );
+    colMap = 0;
+    colMapMask = 0;
 
     _statementType = STMT_NONE;
     last_insert_id = -1;
@@ -301,7 +487,7 @@ void DBResult::Print()
 {
     for ( unsigned int i = 0; i < col_names.count(); i++ )
     {  
-        printf( "%s%s", col_names[i]->str, separator.str );
+        printf( "%s%s", col_names[i], separator.str );
     }
     printf( "\n" );
 
@@ -351,7 +537,7 @@ int DBSqlite::try_open_db()
 
             if ( 0 == db ) { 
                 // not found: try to open by db_name
-                sqlite3_open( db_name.str, &db );
+                sqlite3_open_v2( db_name.str, &db, open_flags, 0 );
                 if ( 0 == db ) {
                     error( "database: \"%s\" could not be opened\n", db_name.str );
                 }
@@ -372,7 +558,7 @@ int DBSqlite::try_open_db()
             free( path );
             path = 0;
             if ( 0 == db ) { 
-                sqlite3_open( fullpath.str, &db );
+                sqlite3_open_v2( fullpath.str, &db, open_flags, 0 );
                 if (db == 0) {
                     error( "database: \"%s\" found but could not be opened\n", fullpath.str );
                 }
@@ -383,16 +569,90 @@ int DBSqlite::try_open_db()
     else
     {
         if ( 0 == db ) {
-            sqlite3_open( fullpath.str, &db );
+            sqlite3_open_v2( fullpath.str, &db, open_flags, 0 );
             if (db == 0) {
                 error( "database: \"%s\" could not be opened\n", fullpath.str );
             }
         }
     }
 
+    applyPragmas();
+
     return 1;
 }
 
+void DBSqlite::applyPragma( unsigned int i )
+{
+    if ( !db || i >= pragma_names.count() )
+        return;
+
+    basicString_t q;
+    char * errmsg = 0;
+    q.sprintf( "PRAGMA %s = %s;", pragma_names[i]->str, pragma_values[i]->str );
+    if ( sqlite3_exec( db, q.str, 0, 0, &errmsg ) != SQLITE_OK )
+        warning( "\"%s\" failed: %s\n", q.str, errmsg ? errmsg : "" );
+    sqlite3_free( errmsg );
+}
+
+void DBSqlite::applyPragmas()
+{
+    for ( unsigned int i = 0; i < pragma_names.count(); i++ )
+        applyPragma( i );
+}
+
+DBSqlite * DBSqlite::reader()
+{
+    try_open_db();
+    if ( !db || 0 == fullpath.length() )
+        return 0;
+
+    DBSqlite * r = new DBSqlite( db_name.str );
+    r->fullpath = fullpath;
+    r->open_flags = SQLITE_OPEN_READONLY;
+
+    // the journal mode belongs to the file, and a reader can't change it
+    for ( unsigned int i = 0; i < pragma_names.count(); i++ ) {
+        if ( !pragma_names[i]->icompare( "journal_mode" ) )
+            r->setPragma( pragma_names[i]->str, pragma_values[i]->str );
+    }
+    // a checkpoint can briefly lock out readers
+    r->setPragma( "busy_timeout", "2000" );
+
+    return r;
+}
+
+DBBackground * DBSqlite::background()
+{
+    if ( bg || bgFailed )
+        return bg;
+
+    DBSqlite * r = reader();
+    bg = r ? DBBackground::start( r ) : 0;
+    if ( !bg )
+        bgFailed = true;
+    return bg;
+}
+
+void DBSqlite::setPragma( const char * name, const char * value )
+{
+    if ( !name || !*name || !value || !*value )
+        return;
+
+    unsigned int i;
+    for ( i = 0; i < pragma_names.count(); i++ ) {
+        if ( pragma_names[i]->icompare( name ) ) {
+            pragma_values[i]->set( value );
+            break;
+        }
+    }
+    if ( i == pragma_names.count() ) {
+        pragma_names.push_back( name );
+        pragma_values.push_back( value );
+    }
+
+    applyPragma( i );
+}
+
 
 
 
@@ -403,38 +663,22 @@ DBStatementType DBSqlite::determine_statement_type( const char * str )
     if ( !str || !*str )
         return STMT_ERROR;
 
-    // GNU strcasestr is not null safe; use basicString_t::stristr() instead
-    basicString_t query( str );
-
-    // detecting first token at beginning of string should ensure the type of the query
-
-    if ( query.stristr( "INSERT" ) == query.str )
-    {
-        return STMT_INSERT;
-    }
-    else if ( query.stristr( "SELECT" ) == query.str )
-    {
-        return STMT_SELECT;
-    }
-    else if ( query.stristr( "UPDATE" ) == query.str )
+    // detecting first token at beginning of string should ensure the type of the query.
+    //  Only the start is compared, no need to search the whole statement
+    static const struct { const char * word; DBStatementType type; } leading[] = {
+        { "INSERT", STMT_INSERT },
+        { "SELECT", STMT_SELECT },
+        { "UPDATE", STMT_UPDATE },
+        { "CREATE", STMT_CREATE },
+        { "DELETE", STMT_DELETE },
+        { "ALTER TABLE", STMT_ALTER },
+        { "DROP TABLE", STMT_DROP },
+    };
+
+    for ( unsigned int i = 0; i < sizeof(leading)/sizeof(leading[0]); i++ )
     {
-        return STMT_UPDATE;
-    }
-    else if ( query.stristr( "CREATE" ) == query.str )
-    {
-        return STMT_CREATE;
-    }
-    else if ( query.stristr( "DELETE" ) == query.str )
-    {
-        return STMT_DELETE;
-    }
-    else if ( query.stristr( "ALTER TABLE" ) == query.str )
-    {
-        return STMT_ALTER;
-    }
-    else if ( query.stristr( "DROP TABLE" ) == query.str )
-    {
-        return STMT_DROP;
+        if ( strncasecmp( str, leading[i].word, strlen( leading[i].word ) ) == 0 )
+            return leading[i].type;
     }
 
     return STMT_ERROR;
@@ -446,6 +690,7 @@ void DBSqlite::setColumnNamePointers( DBResult& result )
     for ( unsigned int j = 0; j < result.numRows(); j++ )
     {  
         DBRow & row = result[ j ];
+        row.setOwner( &result );
         for ( unsigned int i = 0; i < row.numCols(); i++ )
         {  
             row[i].setName( result.colName(i) );
@@ -454,6 +699,14 @@ void DBSqlite::setColumnNamePointers( DBResult& result )
 }
 
 DBResult * DBSqlite::query( const char * str ) 
+{
+    DBResult * result = queryUnsaved( str );
+    if ( result )
+        savedResults.add( result );
+    return result;
+}
+
+DBResult * DBSqlite::queryUnsaved( const char * str ) 
 {
     if ( !str || !*str )
         return 0;
@@ -467,8 +720,10 @@ DBResult * DBSqlite::query( const char * str )
 
     DBStatementType _type = determine_statement_type( str );
 
-    if ( STMT_ERROR == _type )
+    if ( STMT_ERROR == _type ) {
+        failed( "unknown statement type" );
         return 0;
+    }
 
     DBResult * result = new DBResult;
 
@@ -490,6 +745,7 @@ DBResult * DBSqlite::query( const char * str )
     {
         errmsg = sqlite3_errmsg(db);
         warning( "sqlite3_prepare_v2 returned: %s with message: \"%s\", on query string: \"%s\"\n", sqlite_error_string(rc), errmsg, str );
+        failed( errmsg );
         delete result;
         return 0;
     }
@@ -507,7 +763,7 @@ DBResult * DBSqlite::query( const char * str )
         {
             int nCol = sqlite3_column_count(pStmt);
 
-            DBRow * row = new DBRow( rowNum++ ); 
+            DBRow * row = result->newRow( rowNum++, nCol );
 
             for ( int i = 0; needColNames && i < nCol; i++ ) 
             {
@@ -516,29 +772,17 @@ DBResult * DBSqlite::query( const char * str )
             }
             needColNames = false;
 
+            // native type; converted only when a caller asks for something else
             for ( int i = 0; i < nCol; i++ ) 
-            {
-
-                const char *colText = (const char *) sqlite3_column_text(pStmt, i);
-
-                //  SQLITE_INTEGER, SQLITE_FLOAT, SQLITE_TEXT, SQLITE_BLOB, or SQLITE_NULL
-                //int colType = sqlite3_column_type(pStmt, i);
-                //-figure out how to get full-type as a string
-
-                // stop these "(null)" strings from propagating
-                if ( colText && strcmp( "(null)", colText ) )
-                    row->addVal( colText );
-                else
-                    row->addVal( 0 );
-            }
-
-	        result->addRow( row );
+                row->addColumn( pStmt, i );
         }
         else
         // FIXME check for other return types, ie. Errors
         {
             //errmsg = sqlite3_errmsg(db);
             //warning( "sqlite3_step returned: %s with message: \"%s\", on query string: \"%s\"\n", sqlite_error_string(rc), errmsg, str );
+            if ( rc != SQLITE_DONE )
+                failed( sqlite3_errmsg(db) );
             break;
         }
     }
@@ -573,19 +817,76 @@ DBResult * DBSqlite::query( const char * str )
     }
 
     result->setQueryString( str );
-    savedResults.add( result );
 
     return result;
 }
 
 DBSqlite::~DBSqlite()
 {
+    delete bg;
+    bg = 0;
+
     nukeSavedResults();
+    clearStatements();
 
     if ( db ) 
         sqlite3_close( db );
 }
 
+int DBSqlite::columnExists( const char * table, const char * column )
+{
+    if ( !table || !column )
+        return 0;
+
+    try_open_db();
+
+    basicString_t q;
+    sqlite3_stmt * pStmt = 0;
+    if ( sqlite3_prepare_v2( db, q.sprintf( "PRAGMA table_info(%s);", table ).str, -1, &pStmt, 0 ) != SQLITE_OK )
+        return 0;
+
+    int found = 0;
+    while ( !found && sqlite3_step( pStmt ) == SQLITE_ROW ) {
+        const char * name = (const char *) sqlite3_column_text( pStmt, 1 );
+        if ( name && strcasecmp( name, column ) == 0 )
+            found = 1;
+    }
+    sqlite3_finalize( pStmt );
+    return found;
+}
+
+DBStatement * DBSqlite::prepare( const char * name, const char * sql )
+{
+    for ( unsigned int i = 0; i < statements.count(); i++ ) {
+        if ( strcmp( statements[i]->name(), name ) == 0 ) {
+            statements[i]->reset();
+            return statements[i];
+        }
+    }
+
+    try_open_db();
+
+    sqlite3_stmt * pStmt = 0;
+    int rc = sqlite3_prepare_v3( db, sql, -1, SQLITE_PREPARE_PERSISTENT, &pStmt, 0 );
+    if ( rc != SQLITE_OK ) {
+        warning( "sqlite3_prepare_v3 returned: %s with message: \"%s\", on query string: \"%s\"\n", sqlite_error_string(rc), sqlite3_errmsg(db), sql );
+        return 0;
+    }
+
+    DBStatement * st = new DBStatement( db, pStmt, name );
+    statements.add( st );
+    return st;
+}
+
+void DBSqlite::clearStatements()
+{
+    for ( unsigned int i = 0; i < statements.count(); i++ ) {
+        delete statements[i];
+        statements[i] = 0;
+    }
+    statements.reset();
+}
+
 void DBSqlite::nukeSavedResults()
 {
     for ( unsigned int i = 0 ; i < savedResults.count(); i++ ) { 
@@ -625,6 +926,27 @@ void DBSqlite::fixQuotes( basicString_t & S )
     S = fixed;
 }
 
+DBCursor * DBSqlite::cursor( const char * str )
+{
+    if ( !str || !*str )
+        return 0;
+
+    try_open_db();
+
+    basicString_t trimmer( str );
+    trimmer.trim();
+
+    sqlite3_stmt * pStmt = 0;
+    int rc = sqlite3_prepare_v2( db, trimmer.str, -1, &pStmt, 0 );
+    if ( rc != SQLITE_OK ) {
+        warning( "sqlite3_prepare_v2 returned: %s with message: \"%s\", on query string: \"%s\"\n", sqlite_error_string(rc), sqlite3_errmsg(db), trimmer.str );
+        failed( sqlite3_errmsg(db) );
+        return 0;
+    }
+
+    return new DBCursor( db, pStmt, trimmer.str );
+}
+
 void DBSqlite::BeginTransaction()
 {
     try_open_db();
@@ -641,3 +963,279 @@ void DBSqlite::Commit()
     sqlite3_exec(db, "END TRANSACTION;", 0, 0, 0);
 }
 
+// note a statement that didn't run
+void DBSqlite::failed( const char * why )
+{
+    ++errors;
+    lastError = why;
+}
+
+void DBSqlite::Rollback()
+{
+    try_open_db();
+
+    sqlite3_exec(db, "ROLLBACK TRANSACTION;", 0, 0, 0);
+}
+
+
+
+//
+// DBStatement
+//
+DBStatement::~DBStatement()
+{
+    if ( stmt )
+        sqlite3_finalize( stmt );
+}
+
+int DBStatement::check( int rc, int index )
+{
+    if ( rc != SQLITE_OK )
+        warning( "binding parameter %d of \"%s\" returned: %s\n", index, _name.str, sqlite_error_string(rc) );
+    return rc;
+}
+
+DBStatement& DBStatement::bind( int index, int i )
+{
+    check( sqlite3_bind_int( stmt, index, i ), index );
+    return *this;
+}
+
+DBStatement& DBStatement::bind( int index, long long i )
+{
+    check( sqlite3_bind_int64( stmt, index, i ), index );
+    return *this;
+}
+
+DBStatement& DBStatement::bind( int index, double f )
+{
+    check( sqlite3_bind_double( stmt, index, f ), index );
+    return *this;
+}
+
+DBStatement& DBStatement::bind( int index, const char * s, int len )
+{
+    if ( !s )
+        return bindNull( index );
+    check( sqlite3_bind_text( stmt, index, s, len, SQLITE_TRANSIENT ), index );
+    return *this;
+}
+
+DBStatement& DBStatement::bindBlob( int index, const void * p, int len )
+{
+    check( sqlite3_bind_blob( stmt, index, p, len, SQLITE_TRANSIENT ), index );
+    return *this;
+}
+
+DBStatement& DBStatement::bindNull( int index )
+{
+    check( sqlite3_bind_null( stmt, index ), index );
+    return *this;
+}
+
+int DBStatement::step()
+{
+    int rc = sqlite3_step( stmt );
+    if ( rc != SQLITE_ROW && rc != SQLITE_DONE )
+        warning( "sqlite3_step returned: %s with message: \"%s\", on statement \"%s\"\n", sqlite_error_string(rc), sqlite3_errmsg(db), _name.str );
+    return rc;
+}
+
+int DBStatement::exec()
+{
+    int rc;
+    while ( (rc = step()) == SQLITE_ROW )
+        ;
+    sqlite3_reset( stmt );
+    return rc == SQLITE_DONE;
+}
+
+void DBStatement::reset()
+{
+    sqlite3_reset( stmt );
+    sqlite3_clear_bindings( stmt );
+}
+
+
+//
+// DBCursor
+//
+bool DBCursor::next()
+{
+    if ( _done )
+        return false;
+
+    if ( step() != SQLITE_ROW ) {
+        _done = true;
+        return false;
+    }
+
+    ++_rows;
+    return true;
+}
+
+int DBCursor::colIndex( strView_t name )
+{
+    if ( name.empty() )
+        return -1;
+
+    int n = numCols();
+    for ( int i = 0; i < n; i++ ) {
+        const char * c = colName( i );
+        if ( c && colNameIs( c, name ) )
+            return i;
+    }
+    return -1;
+}
+
+const char * DBCursor::getString( int col )
+{
+    if ( col < 0 || col >= numCols() )
+        return 0;
+
+    const char * p = (const char *) sqlite3_column_text( stmt, col );
+    if ( !p || !*p || strcmp( "(null)", p ) == 0 )
+        return 0;
+    return p;
+}
+
+
+//
+// DBBackground
+//
+DBBackground::DBBackground( DBSqlite * r ) : reader(r), head(0), tail(0), quit(false), started(false)
+{
+    pthread_mutex_init( &lock, 0 );
+    pthread_cond_init( &cond, 0 );
+}
+
+DBBackground * DBBackground::start( DBSqlite * reader )
+{
+    DBBackground * bg = new DBBackground( reader );
+    if ( pthread_create( &bg->thread, 0, run, bg ) ) {
+        warning( "couldn't start background reader; pages will be read as needed\n" );
+        delete bg;
+        return 0;
+    }
+    bg->started = true;
+    return bg;
+}
+
+DBBackground::~DBBackground()
+{
+    if ( started ) {
+        pthread_mutex_lock( &lock );
+        quit = true;
+        pthread_cond_broadcast( &cond );
+        pthread_mutex_unlock( &lock );
+        pthread_join( thread, 0 );
+    }
+
+    // never started
+    while ( head ) {
+        DBRequest * r = head;
+        head = r->next;
+        delete r;
+    }
+
+    pthread_cond_destroy( &cond );
+    pthread_mutex_destroy( &lock );
+    delete reader;
+}
+
+DBRequest * DBBackground::submit( const char * sql )
+{
+    DBRequest * r = new DBRequest( sql );
+
+    pthread_mutex_lock( &lock );
+    if ( tail )
+        tail->next = r;
+    else
+        head = r;
+    tail = r;
+    pthread_cond_broadcast( &cond );
+    pthread_mutex_unlock( &lock );
+    return r;
+}
+
+int DBBackground::collect( DBRequest * r, bool wait, DBResult ** res )
+{
+    pthread_mutex_lock( &lock );
+    while ( wait && r->state != DONE )
+        pthread_cond_wait( &cond, &lock );
+    int done = r->state == DONE;
+    pthread_mutex_unlock( &lock );
+
+    if ( !done )
+        return 0;
+
+    *res = r->res;
+    delete r;
+    return 1;
+}
+
+void DBBackground::cancel( DBRequest * r )
+{
+    if ( !r )
+        return;
+
+    pthread_mutex_lock( &lock );
+    if ( r->state == RUNNING ) {
+        r->abandoned = true;
+        r = 0;
+    }
+    else if ( r->state == QUEUED ) {
+        DBRequest ** p = &head;
+        DBRequest * prev = 0;
+        while ( *p != r ) {
+            prev = *p;
+            p = &(*p)->next;
+        }
+        *p = r->next;
+        if ( tail == r )
+            tail = prev;
+    }
+    pthread_mutex_unlock( &lock );
+
+    if ( r ) {
+        delete r->res;
+        delete r;
+    }
+}
+
+// runs the queue on its own connection, until told to quit
+void * DBBackground::run( void * arg )
+{
+    DBBackground * bg = static_cast<DBBackground *>( arg );
+
+    pthread_mutex_lock( &bg->lock );
+    for ( ;; )
+    {
+        while ( !bg->head && !bg->quit )
+            pthread_cond_wait( &bg->cond, &bg->lock );
+        if ( bg->quit )
+            break;
+
+        DBRequest * r = bg->head;
+        bg->head = r->next;
+        if ( !bg->head )
+            bg->tail = 0;
+        r->next = 0;
+        r->state = RUNNING;
+        pthread_mutex_unlock( &bg->lock );
+
+        DBResult * res = bg->reader->queryUnsaved( r->sql.str );
+
+        pthread_mutex_lock( &bg->lock );
+        if ( r->abandoned ) {
+            delete res;
+            delete r;
+            continue;
+        }
+        r->res = res;
+        r->state = DONE;
+        pthread_cond_broadcast( &bg->cond );
+    }
+    pthread_mutex_unlock( &bg->lock );
+    return 0;
+}
@@ -28,6 +28,7 @@ along with RSS Power Tool  If not, see <http://www.gnu.org/licenses/>.
 
 
 #include <string.h>
+#include <pthread.h>
 #include "sqlite3.h"
 
 #include "datastruct.h"     // cppbuffer_t
@@ -52,43 +53,82 @@ STMT_DROP,
 
 
 
+#define DBVALUE_INLINE  24  // text this short (with its terminator) lives in the value itself
+
+
 /********************************************************
  *
  *  DBValue
  *
+ *  - one column of one row. Keeps the type sqlite gave it
+ *    (SQLITE_INTEGER, SQLITE_FLOAT, SQLITE_TEXT, SQLITE_BLOB or
+ *    SQLITE_NULL) and converts only when asked for another
+ *
  */
 class DBValue
 {
 protected:
-    int             ival;
-    double          fval;
-    basicString_t   sval;
+    int             _type;
+    union {
+        long long   i;
+        double      f;
+    } num;
+
+    // text, or numbers formatted on request. 0 until there is some
+    mutable char *          text;
+    mutable unsigned int    textLen;
+    mutable bool            ownText;    // text was malloc'd; false when it is in small or an arena
+    mutable char            small[ DBVALUE_INLINE ];
+
+    const char*     _name; // points to DBResult::col_names[N]
+
+    void setText( const char *, unsigned int ) const;
+    void freeText() const;
 
-    const char*     _name; // points to DBResult::col_names[N].str
+    // not copyable; rows move them with take()
+    DBValue( const DBValue& );
+    DBValue& operator=( const DBValue& );
 
 public:
 
-    DBValue() : ival(0),fval(0),sval(),_name(0) 
-    { }
+    DBValue() : _type(SQLITE_NULL), text(0), textLen(0), ownText(false), _name(0)
+    { num.i = 0; }
 
     DBValue( int i );
     DBValue( double f );
     DBValue( const char * );
 
-    void setInt( int );
+    void setInt( int i ) { setInt64( i ); }
+    void setInt64( long long );
     void setFloat( double );
     void setString( const char * );
+    void setNull();
     void setName( const char *n ) { _name = n; }
 
-    int getInt() const { return ival; }
-    double getFloat() const { return fval; }
-    const char * getString() const { return sval.str; }
+    // from the row the statement is on. Long text goes in the arena, if
+    //  there is one, and must not outlive it
+    void setColumn( sqlite3_stmt *, int col, arena_t * =0 );
+
+    // steal v's contents, leaving it null
+    void take( DBValue& v );
+
+    int type() const { return _type; }
+    bool isNull() const { return _type == SQLITE_NULL; }
+
+    int getInt() const { return (int) getInt64(); }
+    long long getInt64() const;
+    double getFloat() const;
+    // 0 for null and for empty text
+    const char * getString() const;
     const char * name() { return _name; }
     
-    ~DBValue(); 
+    ~DBValue() { freeText(); }
 };
 
 
+class DBResult;
+
+
 /********************************************************
  *
  *  DBRow
@@ -98,29 +138,42 @@ class DBRow
 {
 protected:
 
-    cppbuffer_t<DBValue*> values;
+    DBValue *       values;     // one allocation per row
+    unsigned int    ncols;
+    unsigned int    cap;
     int _rowNum;
 
+    DBResult *      owner;      // resolves column names; set on select results
+    arena_t *       arena;      // where values and their text live, when not the heap
+
+    DBValue & next();
+    DBValue * newValues( unsigned int );
+
 public:
 
-    DBRow() : values(), _rowNum(0)
+    DBRow() : values(0), ncols(0), cap(0), _rowNum(0), owner(0), arena(0)
     { }
-    DBRow( int _num ) : values(), _rowNum(_num)
+    DBRow( int _num ) : values(0), ncols(0), cap(0), _rowNum(_num), owner(0), arena(0)
     { }
+    DBRow( int _num, unsigned int _cols, arena_t * a =0 ) : values(0), ncols(0), cap(_cols), _rowNum(_num), owner(0), arena(a)
+    { values = newValues( cap ); }
     ~DBRow(); 
 
-    //void addVal( const DBValue & v ) { values.push_back( v ); }
     void addVal( const char * );
+    void addColumn( sqlite3_stmt * s, int col ) { next().setColumn( s, col, arena ); }
 
-    unsigned int size() { return values.size(); }
-    unsigned int numCols() { return values.size(); }
+    unsigned int size() { return ncols; }
+    unsigned int numCols() { return ncols; }
 
     DBValue & operator[] ( unsigned int );
 
+    // by index from result_t::colIndex(); 0 when the index is -1 or out of range
+    DBValue * column( int i ) { return i >= 0 && (unsigned) i < ncols ? &values[i] : 0; }
+
     int rowNum() const { return _rowNum; }
+    void setOwner( DBResult * r ) { owner = r; }
 
-    DBValue * FindByName( const char * colname );
-    DBValue * FindByName( const basicString_t& colname );
+    DBValue * FindByName( strView_t colname );
 
     // these all return 0 if column name is not found
     const char * getString( const char * );
@@ -134,6 +187,11 @@ struct result_t
 {
     virtual DBRow & operator[] ( unsigned int ) = 0;
     virtual unsigned int numRows() = 0;
+
+    // position of a column in every row, for DBRow::column(). Resolve once
+    //  before a loop instead of looking names up in each row. -1 if not found
+    virtual int colIndex( strView_t ) = 0;
+
     virtual ~result_t() { }
 };
 
@@ -147,9 +205,13 @@ class DBResult : public result_t
 {
 protected:
 
+    // rows, their values, long text and the column names all come out of
+    //  here, and go back in one go when the result is erased
+    arena_t arena;
+
     cppbuffer_t<DBRow*> rows;
     
-    cppbuffer_t<basicString_t*> col_names;
+    cppbuffer_t<const char*> col_names;
     
     int last_insert_id;
 
@@ -163,14 +225,21 @@ protected:
 
     unsigned int nextCount;
 
+    // open addressed, case-insensitive name -> (index+1); built on first use
+    int * colMap;
+    unsigned int colMapMask;
+
+    void buildColMap();
+
 public:
 
-    DBResult() : rows(), col_names(), last_insert_id(-1), _statementType(STMT_NONE), query_string(), _rows_updated(0), separator("\t"), nextCount((unsigned)-1)
+    DBResult() : arena(), rows(), col_names(), last_insert_id(-1), _statementType(STMT_NONE), query_string(), _rows_updated(0), separator("\t"), nextCount((unsigned)-1), colMap(0), colMapMask(0)
     {}
 
     virtual ~DBResult();
 
-    void addRow( DBRow* r ) { rows.push_back( r ); }
+    // a new row at the end, allocated from the result
+    DBRow * newRow( int num, unsigned int cols );
 
     unsigned int numRows() { return rows.size(); }
     unsigned int size() { return rows.size(); }
@@ -184,6 +253,7 @@ public:
 
     unsigned int colCount() { return col_names.size(); }
     const char * colName( unsigned int );
+    int colIndex( strView_t );
 
     // returns -1 when not STMT_INSERT
     int lastInsertId() const { return last_insert_id; }
@@ -209,6 +279,170 @@ public:
 };
 
 
+/********************************************************
+ *
+ *  DBStatement
+ *
+ *  - a prepared statement, kept by DBSqlite and reused by name.
+ *    Values are bound, not quoted into the sql, so there is
+ *    nothing to escape and sqlite parses the statement only once.
+ *    Parameters and columns count from 1 and 0, as in sqlite.
+ *
+ */
+class DBStatement
+{
+protected:
+    sqlite3 *       db;
+    sqlite3_stmt *  stmt;
+    basicString_t   _name;
+
+    int check( int rc, int index );
+
+public:
+
+    DBStatement( sqlite3 * d, sqlite3_stmt * s, const char * n ) : db(d), stmt(s), _name(n)
+    { }
+    ~DBStatement();
+
+    const char * name() const { return _name.str; }
+
+    // a null pointer binds NULL
+    DBStatement& bind( int index, int );
+    DBStatement& bind( int index, long long );
+    DBStatement& bind( int index, double );
+    DBStatement& bind( int index, const char *, int len =-1 );
+    DBStatement& bind( int index, const basicString_t& s ) { return bind( index, s.str, (int) s.length() ); }
+    DBStatement& bindBlob( int index, const void *, int len );
+    DBStatement& bindNull( int index );
+
+    // SQLITE_ROW while there are rows, then SQLITE_DONE, or an error
+    int step();
+
+    // runs it to the end and resets; 1 on success
+    int exec();
+
+    // the current row, after step() returned SQLITE_ROW
+    int getInt( int col ) { return sqlite3_column_int( stmt, col ); }
+    long long getInt64( int col ) { return sqlite3_column_int64( stmt, col ); }
+    double getFloat( int col ) { return sqlite3_column_double( stmt, col ); }
+    const char * getString( int col ) { return (const char *) sqlite3_column_text( stmt, col ); }
+    const void * getBlob( int col ) { return sqlite3_column_blob( stmt, col ); }
+    int getBytes( int col ) { return sqlite3_column_bytes( stmt, col ); }
+    bool isNull( int col ) { return sqlite3_column_type( stmt, col ) == SQLITE_NULL; }
+
+    // ready to run again; bindings are cleared
+    void reset();
+
+    int lastInsertId() const { return (int) sqlite3_last_insert_rowid( db ); }
+    int rowsUpdated() const { return sqlite3_changes( db ); }
+};
+
+
+/********************************************************
+ *
+ *  DBCursor
+ *
+ *  - a forward-only walk over a select, one row at a time.
+ *    Nothing is copied: strings point into sqlite's current
+ *    row and are good until the next call to next(). Use it
+ *    where a DBResult would hold a whole table in memory.
+ *    The caller deletes it, which finalizes the statement.
+ *
+ */
+class DBCursor : public DBStatement
+{
+protected:
+    int             _rows;      // rows handed out so far
+    bool            _done;      // stepping again would start it over
+
+public:
+
+    DBCursor( sqlite3 * d, sqlite3_stmt * s, const char * sql ) : DBStatement( d, s, sql ), _rows(0), _done(false)
+    { }
+
+    // on to the next row; false after the last one, or on error
+    bool next();
+
+    // rows handed out so far, which is also the number of the current one
+    int rowNum() const { return _rows; }
+
+    int numCols() { return sqlite3_column_count( stmt ); }
+    const char * colName( int col ) { return sqlite3_column_name( stmt, col ); }
+
+    // case-insensitive, like DBResult::colIndex(). -1 if not found
+    int colIndex( strView_t );
+
+    // as DBValue::getString(): 0 for null, empty and "(null)" text.
+    //  also 0 when col is -1
+    const char * getString( int col );
+};
+
+
+class DBSqlite;
+
+// one select handed to a DBBackground, and its result handed back
+struct DBRequest
+{
+    basicString_t   sql;
+    DBResult *      res;
+    int             state;      // DBBackground::QUEUED, RUNNING or DONE
+    bool            abandoned;  // the worker frees it when it's done
+    DBRequest *     next;       // in the queue
+
+    DBRequest( const char * s ) : sql(s), res(0), state(0), abandoned(false), next(0)
+    { }
+};
+
+/********************************************************
+ *
+ *  DBBackground
+ *
+ *  - one worker thread with its own read-only connection, that
+ *    runs the selects it is handed in the order they came. Every
+ *    reader of a database shares the one DBSqlite::background()
+ *    gives out, rather than each starting its own.
+ *
+ */
+class DBBackground
+{
+protected:
+    DBSqlite *          reader;
+    pthread_t           thread;
+    pthread_mutex_t     lock;
+    pthread_cond_t      cond;
+    DBRequest *         head;
+    DBRequest *         tail;
+    bool                quit;
+    bool                started;    // thread is running
+
+    static void * run( void * );
+
+    DBBackground( DBSqlite * r );
+
+    // not copyable
+    DBBackground( const DBBackground& );
+    DBBackground& operator=( const DBBackground& );
+
+public:
+    enum { QUEUED, RUNNING, DONE };
+
+    // takes reader. 0 if the thread doesn't start, and reader is deleted
+    static DBBackground * start( DBSqlite * reader );
+    ~DBBackground();
+
+    // queue a select; the request belongs to the caller until it is
+    //  handed to collect() or cancel()
+    DBRequest * submit( const char * sql );
+
+    // 1 once it has run, freeing the request and leaving its result,
+    //  which may be 0, in res. 0 while it hasn't, unless told to wait
+    int collect( DBRequest *, bool wait, DBResult ** res );
+
+    // no longer wanted; frees it now or once the worker is done with it
+    void cancel( DBRequest * );
+};
+
+
 /********************************************************
  *
  *  DBSqlite
@@ -225,12 +459,31 @@ protected:
 
     sqlite3 *db;
 
+    int open_flags;         // for sqlite3_open_v2
+
+    DBBackground * bg;      // started by background()
+    bool bgFailed;
+
+    unsigned int errors;    // statements that failed to prepare or run
+    basicString_t lastError;
+
+    void failed( const char * why );
+
     cppbuffer_t<DBResult *> savedResults;
 
+    cppbuffer_t<DBStatement *> statements;
+
+    // pragma names and values, run on the connection as it opens
+    stringbuffer_t pragma_names;
+    stringbuffer_t pragma_values;
+
 
     //
     int try_open_db();
 
+    void applyPragma( unsigned int );
+    void applyPragmas();
+
     DBStatementType determine_statement_type( const char * );
 
     void setColumnNamePointers( DBResult& );
@@ -238,10 +491,10 @@ protected:
 public:
     // not wise, you almost always want a named DB to do any real work
     //  never-the-less, this might be useful for debugging/testing
-    DBSqlite() : db_name( NO_DB_NAME ), fullpath(), db(0)
+    DBSqlite() : db_name( NO_DB_NAME ), fullpath(), db(0), open_flags( SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE ), bg(0), bgFailed(false), errors(0), lastError()
     { }
     
-    DBSqlite( const char * name ) : db_name( name ), fullpath(), db(0)
+    DBSqlite( const char * name ) : db_name( name ), fullpath(), db(0), open_flags( SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE ), bg(0), bgFailed(false), errors(0), lastError()
     { }
 
     void setName( const char * new_name ) {
@@ -255,7 +508,14 @@ public:
 
     // interface
     DBResult * query( const char * );
+
+    // same, but the result isn't kept with the others; the caller deletes it
+    DBResult * queryUnsaved( const char * );
     DBResult * operator()( const char * s ) { return query(s); }
+
+    // a cursor over a select, for walking results too big to keep.
+    //  0 if it doesn't compile
+    DBCursor * cursor( const char * );
     
     const char * name() const { return db_name.str; }
 
@@ -263,6 +523,35 @@ public:
 
     void BeginTransaction();
     void Commit();
+    void Rollback();
+
+    // statements that have failed so far; compare before and after a batch.
+    //  errorMessage() is sqlite's message for the most recent one
+    unsigned int errorCount() const { return errors; }
+    const char * errorMessage() const { return lastError.str ? lastError.str : ""; }
+
+    // the statement cached as name, reset and ready to bind; prepared from
+    //  sql the first time. 0 if sql doesn't compile
+    DBStatement * prepare( const char * name, const char * sql );
+
+    // finalize every cached statement
+    void clearStatements();
+
+    // 1 if table has a column by that name
+    int columnExists( const char * table, const char * column );
+
+    // PRAGMA name = value, each time the database is opened; run now if it
+    //  already is. Setting a name again replaces its value
+    void setPragma( const char * name, const char * value );
+
+    // a second, read-only connection to the same file, with the same
+    //  pragmas, for use on another thread. 0 if there is no file to share.
+    //  The caller deletes it
+    DBSqlite * reader();
+
+    // the worker that runs selects ahead of need, on a reader(). Started on
+    //  first use and shared by every caller; 0 if it can't be
+    DBBackground * background();
 
 }; // DBSqlite
 
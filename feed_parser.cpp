@@ -0,0 +1,618 @@
+/*
+======================================================================
+
+RSS Power Tool Source Code
+Copyright (C) 2013 Gregory Naughton
+
+This file is part of RSS Power Tool
+
+RSS Power Tool is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+RSS Power Tool is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with RSS Power Tool  If not, see <http://www.gnu.org/licenses/>.
+
+======================================================================
+*/
+
+// feed_parser.cpp
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <strings.h>
+
+#include "feed_parser.h"
+#include "tinyxml2.h"       // XMLUtil::ConvertUTF32ToUTF8
+
+
+// 1 if p could still turn out to be lit, once more bytes come
+static inline int partial_prefix( const char * p, unsigned int n, const char * lit )
+{
+    unsigned int l = strlen( lit );
+    return n < l && memcmp( p, lit, n ) == 0;
+}
+
+static inline int has_prefix( const char * p, unsigned int n, const char * lit )
+{
+    unsigned int l = strlen( lit );
+    return n >= l && memcmp( p, lit, l ) == 0;
+}
+
+static inline int is_space( char c )
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+// basicString_t::append() takes a 0 length to mean strlen()
+static inline void append_n( basicString_t& out, const char * p, unsigned int n )
+{
+    if ( n )
+        out.append( p, n );
+}
+
+// xml's 5 named entities plus numeric ones, and newline normalization; same as tinyxml2
+static void append_decoded( basicString_t& out, const char * s, unsigned int n )
+{
+    const char * e = s + n;
+    const char * run = s;
+
+    while ( s < e )
+    {
+        if ( *s == '\r' ) {
+            append_n( out, run, s - run );
+            out.append( "\n", 1 );
+            if ( s + 1 < e && s[1] == '\n' )
+                ++s;
+            run = ++s;
+            continue;
+        }
+
+        if ( *s != '&' ) {
+            ++s;
+            continue;
+        }
+
+        const char * semi = (const char *) memchr( s, ';', e - s < 12 ? e - s : 12 );
+        if ( !semi ) {
+            ++s;
+            continue;
+        }
+
+        const char * rep = 0;
+        char buf[ 8 ];
+        unsigned int nlen = semi - s - 1;
+        const char * name = s + 1;
+
+        if ( nlen == 2 && !strncmp( name, "lt", 2 ) )          rep = "<";
+        else if ( nlen == 2 && !strncmp( name, "gt", 2 ) )     rep = ">";
+        else if ( nlen == 3 && !strncmp( name, "amp", 3 ) )    rep = "&";
+        else if ( nlen == 4 && !strncmp( name, "quot", 4 ) )   rep = "\"";
+        else if ( nlen == 4 && !strncmp( name, "apos", 4 ) )   rep = "'";
+        else if ( nlen > 1 && *name == '#' )
+        {
+            unsigned long cp = ( name[1] == 'x' || name[1] == 'X' ) ? strtoul( name + 2, 0, 16 ) : strtoul( name + 1, 0, 10 );
+            int l = 0;
+            if ( cp ) {
+                tinyxml2::XMLUtil::ConvertUTF32ToUTF8( cp, buf, &l );
+                buf[ l ] = '\0';
+                rep = buf;
+            }
+        }
+
+        if ( !rep ) {
+            ++s;
+            continue;
+        }
+
+        append_n( out, run, s - run );
+        append_n( out, rep, strlen( rep ) );
+        run = s = semi + 1;
+    }
+
+    append_n( out, run, s - run );
+}
+
+// value of attribute name in 'a="1" b='2'', entity decoded. 0 if not found
+static int find_attr( const char * attrs, unsigned int n, const char * name, basicString_t& out )
+{
+    const char * p = attrs;
+    const char * e = attrs + n;
+    unsigned int nl = strlen( name );
+
+    while ( p < e )
+    {
+        while ( p < e && is_space( *p ) )
+            ++p;
+        const char * an = p;
+        while ( p < e && *p != '=' && !is_space( *p ) && *p != '/' )
+            ++p;
+        unsigned int al = p - an;
+        while ( p < e && is_space( *p ) )
+            ++p;
+        if ( p >= e || *p != '=' ) {
+            if ( p < e ) ++p;
+            continue;
+        }
+        ++p;
+        while ( p < e && is_space( *p ) )
+            ++p;
+        if ( p >= e || (*p != '"' && *p != '\'') )
+            return 0;
+        char q = *p++;
+        const char * v = p;
+        while ( p < e && *p != q )
+            ++p;
+        if ( al == nl && !strncmp( an, name, nl ) ) {
+            out.erase();
+            append_decoded( out, v, p - v );
+            return 1;
+        }
+        ++p;
+    }
+    return 0;
+}
+
+static inline int is_name( const char * a, const char * b )
+{
+    return strcasecmp( a, b ) == 0;
+}
+
+
+/********************************************************************
+ *
+ * feedParser_t
+ *
+ ********************************************************************/
+
+feedParser_t::feedParser_t( feedItem_f cb, void * arg ) : onItem(cb), onItemArg(arg)
+{
+    reset();
+}
+
+void feedParser_t::reset()
+{
+    pending.erase();
+    resume = 0;
+    resumeQuote = 0;
+    resumeBrackets = 0;
+    failed = 0;
+    _type = FEED_UNKNOWN;
+    depth = 0;
+    channelDepth = 0;
+    itemDepth = 0;
+    collectDepth = 0;
+    _itemCount = 0;
+    field.erase();
+    text.erase();
+    inAuthor = 0;
+    inSkipHours = 0;
+    item.clear();
+    chanDescription.erase();
+    chanSubtitle.erase();
+    chanItunesSummary.erase();
+    chanItunesSubtitle.erase();
+    ttl = 0;
+    skip_hours = 0;
+}
+
+int feedParser_t::feed( const char * data, unsigned int n )
+{
+    if ( failed )
+        return 0;
+    if ( !data || !n )
+        return 1;
+
+    pending.append( data, n );
+    scan( 0 );
+    return !failed;
+}
+
+int feedParser_t::finish()
+{
+    if ( !failed )
+        scan( 1 );
+    pending.clearMem();
+    return !failed && _type != FEED_UNKNOWN;
+}
+
+const basicString_t& feedParser_t::description() const
+{
+    if ( chanDescription.length() )
+        return chanDescription;
+    if ( chanSubtitle.length() )
+        return chanSubtitle;
+    if ( chanItunesSummary.length() )
+        return chanItunesSummary;
+    return chanItunesSubtitle;
+}
+
+// consume every whole token in pending; keep the tail for next time
+int feedParser_t::scan( int final )
+{
+    const char * s = pending.str;
+    unsigned int n = pending.length();
+    unsigned int pos = 0;
+
+    // the unfinished token left at the front last time was already searched
+    //  this far, so a long text run or CDATA section isn't searched again
+    //  with every chunk
+    unsigned int from = resume;
+    resume = 0;
+
+    while ( pos < n && !failed )
+    {
+        const char * p = s + pos;
+        unsigned int rem = n - pos;
+        unsigned int skip = pos ? 0 : from;
+
+        // character data runs up to the next tag
+        if ( *p != '<' ) {
+            const char * lt = (const char *) memchr( p + skip, '<', rem - skip );
+            if ( !lt ) {
+                if ( !final ) {
+                    resume = rem;
+                    break;
+                }
+                lt = s + n;
+            }
+            doText( p, lt - p, 0 );
+            pos = lt - s;
+            continue;
+        }
+
+        // not enough yet to tell what kind of markup this is
+        if ( !final && (partial_prefix( p, rem, "<![CDATA[" ) || partial_prefix( p, rem, "<!--" )) )
+            break;
+
+        const char * end = 0;
+
+        // when resuming, back up so a terminator split across chunks is still found
+        if ( has_prefix( p, rem, "<!--" ) ) {
+            unsigned int at = skip > 6 ? skip - 2 : 4;
+            end = (const char *) memmem( p + at, rem - at, "-->", 3 );
+            if ( end )
+                end += 3;
+        }
+        else if ( has_prefix( p, rem, "<![CDATA[" ) ) {
+            unsigned int at = skip > 11 ? skip - 2 : 9;
+            end = (const char *) memmem( p + at, rem - at, "]]>", 3 );
+            if ( end ) {
+                doText( p + 9, end - (p + 9), 1 );
+                end += 3;
+            }
+        }
+        else if ( has_prefix( p, rem, "<?" ) ) {
+            unsigned int at = skip > 3 ? skip - 1 : 2;
+            end = (const char *) memmem( p + at, rem - at, "?>", 2 );
+            if ( end )
+                end += 2;
+        }
+        else if ( has_prefix( p, rem, "<!" ) ) {
+            // <!DOCTYPE ... [ internal subset ] >
+            int brackets = skip > 2 ? resumeBrackets : 0;
+            for ( const char * q = p + (skip > 2 ? skip : 2); q < s + n; q++ ) {
+                if ( *q == '[' ) ++brackets;
+                else if ( *q == ']' ) --brackets;
+                else if ( *q == '>' && brackets <= 0 ) { end = q + 1; break; }
+            }
+            resumeBrackets = brackets;
+        }
+        else {
+            char quote = skip > 1 ? resumeQuote : 0;
+            for ( const char * q = p + (skip > 1 ? skip : 1); q < s + n; q++ ) {
+                if ( quote ) {
+                    if ( *q == quote ) quote = 0;
+                }
+                else if ( *q == '"' || *q == '\'' ) quote = *q;
+                else if ( *q == '>' ) { end = q + 1; break; }
+            }
+            resumeQuote = quote;
+            if ( end )
+                doTag( p + 1, end - p - 2 );
+        }
+
+        if ( !end ) {
+            resume = rem;
+            break; // incomplete; wait for more
+        }
+
+        pos = end - s;
+    }
+
+    if ( final || failed ) {
+        pos = n;
+        resume = 0;
+    }
+
+    // keep the unfinished token
+    unsigned int rem = n - pos;
+    if ( pos > 0 ) {
+        if ( rem )
+            memmove( pending.str, pending.str + pos, rem );
+        pending.str[ rem ] = '\0';
+        pending.len = rem;
+    }
+    return !failed;
+}
+
+void feedParser_t::doTag( const char * body, unsigned int n )
+{
+    if ( n == 0 )
+        return;
+
+    int closing = ( *body == '/' );
+    if ( closing ) {
+        ++body;
+        --n;
+    }
+
+    int empty = ( n > 0 && body[ n - 1 ] == '/' );
+    if ( empty )
+        --n;
+
+    unsigned int nl = 0;
+    while ( nl < n && !is_space( body[nl] ) )
+        ++nl;
+    if ( nl == 0 )
+        return;
+
+    char namebuf[ 128 ];
+    if ( nl >= sizeof(namebuf) )
+        nl = sizeof(namebuf) - 1;
+    memcpy( namebuf, body, nl );
+    namebuf[ nl ] = '\0';
+
+    if ( closing ) {
+        endElement( namebuf );
+        return;
+    }
+
+    startElement( namebuf, body + nl, n - nl, empty );
+    if ( empty )
+        endElement( namebuf );
+}
+
+void feedParser_t::doText( const char * p, unsigned int n, int raw )
+{
+    if ( !collectDepth || collectDepth != depth || !n )
+        return;
+
+    if ( raw )
+        text.append( p, n );
+    else
+        append_decoded( text, p, n );
+}
+
+void feedParser_t::startElement( const char * name, const char * attrs, unsigned int attrLen, int empty )
+{
+    ++depth;
+
+    // root decides the kind of feed
+    if ( depth == 1 )
+    {
+        if ( is_name( name, "rss" ) )
+            _type = FEED_RSS;
+        else if ( is_name( name, "feed" ) ) {
+            _type = FEED_ATOM;
+            channelDepth = 1;
+        }
+        else if ( is_name( name, "rdf:RDF" ) )
+            _type = FEED_RDF;
+        else
+            failed = 1;
+        return;
+    }
+
+    if ( !itemDepth )
+    {
+        if ( _type != FEED_ATOM && depth == 2 && (is_name( name, "channel" ) || is_name( name, "rss:channel" )) ) {
+            channelDepth = depth;
+            return;
+        }
+
+        if ( _type == FEED_ATOM ? is_name( name, "entry" ) : (is_name( name, "item" ) || is_name( name, "rss:item" )) ) {
+            itemDepth = depth;
+            item.clear();
+            return;
+        }
+
+        if ( channelDepth && depth == channelDepth + 1 ) {
+            field = name;
+            text.erase();
+            collectDepth = depth;
+            if ( is_name( name, "skipHours" ) )
+                inSkipHours = 1;
+        }
+        else if ( inSkipHours && depth == channelDepth + 2 && is_name( name, "hour" ) ) {
+            text.erase();
+            collectDepth = depth;
+        }
+        return;
+    }
+
+    // inside an item
+    if ( depth == itemDepth + 1 )
+    {
+        field = name;
+        text.erase();
+        collectDepth = depth;
+        itemField( name, attrs, attrLen );
+    }
+    else if ( inAuthor && depth == itemDepth + 2 && is_name( name, "name" ) )
+    {
+        text.erase();
+        collectDepth = depth;
+    }
+}
+
+// attribute driven fields, handled as the field opens
+void feedParser_t::itemField( const char * name, const char * attrs, unsigned int attrLen )
+{
+    basicString_t v;
+
+    if ( _type == FEED_ATOM )
+    {
+        if ( is_name( name, "link" ) )
+        {
+            // link has higher priority than id, so will overwrite it if found
+            if ( find_attr( attrs, attrLen, "type", v ) && v.icompare( "text/html" ) ) {
+                if ( find_attr( attrs, attrLen, "href", v ) )
+                    item.item_url = v;
+            }
+            else if ( find_attr( attrs, attrLen, "alternate", v ) && v.icompare( "alternate" ) ) {
+                if ( find_attr( attrs, attrLen, "href", v ) )
+                    item.item_url = v;
+            }
+        }
+        else if ( is_name( name, "author" ) )
+        {
+            inAuthor = 1;
+            collectDepth = 0; // only its <name>
+        }
+        return;
+    }
+
+    if ( is_name( name, "enclosure" ) || is_name( name, "media:content" ) )
+    {
+        if ( !item.media_url.length() && find_attr( attrs, attrLen, "url", v ) )
+            item.media_url = v;
+    }
+}
+
+void feedParser_t::endElement( const char * name )
+{
+    if ( depth <= 0 )
+        return;
+
+    if ( collectDepth && collectDepth == depth )
+    {
+        if ( itemDepth ) {
+            if ( inAuthor ) {
+                if ( text.length() )
+                    item.author = text;
+            }
+            else
+                endItemField();
+        }
+        else
+            endChannelField();
+        collectDepth = 0;
+    }
+
+    if ( itemDepth && depth == itemDepth + 1 ) {
+        inAuthor = 0;
+        field.erase();
+    }
+    else if ( itemDepth && depth == itemDepth ) {
+        ++_itemCount;
+        if ( onItem )
+            onItem( &item, onItemArg );
+        itemDepth = 0;
+    }
+    else if ( !itemDepth && channelDepth && depth == channelDepth + 1 ) {
+        inSkipHours = 0;
+        field.erase();
+    }
+
+    --depth;
+}
+
+// text driven item fields. Priorities match the old XMLDocument walkers
+void feedParser_t::endItemField()
+{
+    const char * name = field.str;
+    if ( !name || !text.length() )
+        return;
+
+    if ( _type == FEED_ATOM )
+    {
+        if ( is_name( name, "title" ) )
+            item.title = text;
+        else if ( is_name( name, "summary" ) )
+            item.description = text;
+        else if ( is_name( name, "published" ) )
+            item.pubDate = text; // higher priority than updated, so will overwrite
+        else if ( is_name( name, "updated" ) ) {
+            if ( !item.pubDate.length() )
+                item.pubDate = text;
+        }
+        else if ( is_name( name, "id" ) ) {
+            if ( !item.item_url.length() )
+                item.item_url = text;
+        }
+        else if ( is_name( name, "content" ) )
+            item.content = text;
+        return;
+    }
+
+    basicString_t CONTENT_ENCODED( "content:encoded" );
+
+    if ( is_name( name, "title" ) || is_name( name, "rss:title" ) )
+        item.title = text;
+    else if ( is_name( name, "description" ) )
+        item.description = text; // overrides other descriptions
+    else if ( is_name( name, "itunes:summary" ) || is_name( name, "itunes:subtitle" ) ) {
+        if ( !item.description.length() )
+            item.description = text;
+    }
+    else if ( is_name( name, "pubdate" ) )
+        item.pubDate = text; // higher priority than dc:date
+    else if ( is_name( name, "dc:date" ) ) {
+        if ( !item.pubDate.length() )
+            item.pubDate = text;
+    }
+    else if ( is_name( name, "link" ) || is_name( name, "atom:link" ) || is_name( name, "guid" ) || is_name( name, "rss:link" ) ) {
+        if ( !item.item_url.length() )
+            item.item_url = text;
+    }
+    else if ( CONTENT_ENCODED.stristr( name ) )
+        item.content = text;
+    else if ( is_name( name, "author" ) || is_name( name, "dc:creator" ) || is_name( name, "itunes:author" ) ) {
+        if ( !item.author.length() )
+            item.author = text;
+    }
+}
+
+void feedParser_t::endChannelField()
+{
+    if ( inSkipHours ) {
+        if ( depth == channelDepth + 2 && text.length() ) {
+            int hour = atoi( text.str );
+            if ( hour >= 0 && hour < 24 )
+                skip_hours |= 1u << hour;
+        }
+        return;
+    }
+
+    const char * name = field.str;
+    if ( !name || !text.length() )
+        return;
+
+    // first of each wins
+    if ( is_name( name, "description" ) ) {
+        if ( !chanDescription.length() )
+            chanDescription = text;
+    }
+    else if ( is_name( name, "subtitle" ) ) {
+        if ( !chanSubtitle.length() )
+            chanSubtitle = text;
+    }
+    else if ( is_name( name, "itunes:summary" ) ) {
+        if ( !chanItunesSummary.length() )
+            chanItunesSummary = text;
+    }
+    else if ( is_name( name, "itunes:subtitle" ) ) {
+        if ( !chanItunesSubtitle.length() )
+            chanItunesSubtitle = text;
+    }
+    else if ( is_name( name, "ttl" ) )
+        ttl = atoi( text.str );
+}
@@ -0,0 +1,131 @@
+/*
+======================================================================
+
+RSS Power Tool Source Code
+Copyright (C) 2013 Gregory Naughton
+
+This file is part of RSS Power Tool
+
+RSS Power Tool is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+RSS Power Tool is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with RSS Power Tool  If not, see <http://www.gnu.org/licenses/>.
+
+======================================================================
+*/
+
+// feed_parser.h
+#ifndef __FEED_PARSER_H__
+#define __FEED_PARSER_H__
+
+#include "misc.h"           // basicString_t
+#include "item.h"           // Item_t
+
+
+enum feedType_t
+{
+    FEED_UNKNOWN = 0,
+    FEED_RSS,
+    FEED_ATOM,
+    FEED_RDF,
+};
+
+// called once for each <item> or <entry>, as soon as it closes. The item is
+//  cleared and reused afterwards; copy or move out what you want to keep
+typedef void (*feedItem_f)( Item_t *, void * );
+
+
+/********************************************************
+ *
+ *  feedParser_t
+ *
+ *  - event driven rss/rdf/atom parser. Bytes are pushed in with
+ *    feed() in whatever size chunks they arrive, and items are
+ *    handed to the callback as each one closes, so there is never
+ *    more than one item held in memory and no document tree.
+ *
+ *  - item fields are picked with the same rules and priorities the
+ *    old XMLDocument walkers used, so hashes stay the same
+ *
+ */
+class feedParser_t
+{
+protected:
+    feedItem_f      onItem;
+    void *          onItemArg;
+
+    basicString_t   pending;        // bytes not yet making a whole token
+    unsigned int    resume;         // how much of pending was already searched for its end
+    char            resumeQuote;    // open quote in a tag, at resume
+    int             resumeBrackets; // open [ in a <!DOCTYPE, at resume
+    int             failed;
+
+    feedType_t      _type;
+    int             depth;          // open elements
+    int             channelDepth;   // depth of <channel>, or the atom <feed>
+    int             itemDepth;      // depth of the open item, 0 if none
+    int             collectDepth;   // text inside the element at this depth is kept
+    unsigned int    _itemCount;
+
+    // open field, a direct child of the item or channel
+    basicString_t   field;
+    basicString_t   text;
+    int             inAuthor;       // atom <author>, whose <name> we want
+    int             inSkipHours;
+
+    Item_t          item;
+
+    // channel candidates, in order of preference for description
+    basicString_t   chanDescription;
+    basicString_t   chanSubtitle;
+    basicString_t   chanItunesSummary;
+    basicString_t   chanItunesSubtitle;
+
+    // tokens
+    int scan( int final );
+    void doTag( const char *, unsigned int );
+    void doText( const char *, unsigned int, int raw );
+
+    // events
+    void startElement( const char * name, const char * attrs, unsigned int attrLen, int empty );
+    void endElement( const char * name );
+    void itemField( const char * name, const char * attrs, unsigned int attrLen );
+    void endItemField();
+    void endChannelField();
+
+public:
+
+    int             ttl;            // <ttl>, in minutes
+    unsigned int    skip_hours;     // <skipHours> as a bitmask of hours 0-23
+
+    feedParser_t( feedItem_f cb =0, void * arg =0 );
+    virtual ~feedParser_t() { }
+
+    void setCallback( feedItem_f cb, void * arg ) { onItem = cb; onItemArg = arg; }
+
+    // returns 0 once the input is found not to be xml
+    int feed( const char *, unsigned int );
+
+    // end of input. returns 1 if this was an rss, rdf or atom feed
+    int finish();
+
+    // ready for another document
+    void reset();
+
+    feedType_t type() const { return _type; }
+    unsigned int itemCount() const { return _itemCount; }
+
+    // channel <description>, <subtitle>, <itunes:summary> or <itunes:subtitle>; first found wins
+    const basicString_t& description() const;
+};
+
+
+#endif /* __FEED_PARSER_H__ */
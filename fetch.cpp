@@ -0,0 +1,446 @@
+/*
+======================================================================
+
+RSS Power Tool Source Code
+Copyright (C) 2013 Gregory Naughton
+
+This file is part of RSS Power Tool
+
+RSS Power Tool is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+RSS Power Tool is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with RSS Power Tool  If not, see <http://www.gnu.org/licenses/>.
+
+======================================================================
+*/
+
+// fetch.cpp
+
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "fetch.h"
+
+
+static size_t _storeJob( void *stringBuffer, size_t size, size_t nmemb, void * VoidObject )
+{
+    if ( size > 0 && nmemb > 0 )
+    {
+        fetchJob_t * job = static_cast<fetchJob_t *>( VoidObject );
+        if ( job->write )
+            job->write( job, (const char*)stringBuffer, (unsigned) (size * nmemb), job->write_arg );
+        else
+            job->data.append( (const char*)stringBuffer, (unsigned) (size * nmemb) );
+        job->decoded_bytes += size * nmemb;
+    }
+    return nmemb;
+}
+
+// value of "Name: value\r\n" if the header line is that name, else 0
+static const char * header_value( const char * line, unsigned int len, const char * name, unsigned int * vlen )
+{
+    unsigned int n = strlen( name );
+    if ( len <= n || strncasecmp( line, name, n ) != 0 || line[n] != ':' )
+        return 0;
+
+    const char * v = line + n + 1;
+    const char * e = line + len;
+    while ( v < e && (*v == ' ' || *v == '\t') )
+        ++v;
+    while ( e > v && (e[-1] == '\r' || e[-1] == '\n' || e[-1] == ' ') )
+        --e;
+    *vlen = e - v;
+    return v;
+}
+
+static size_t _storeHeader( char * buffer, size_t size, size_t nmemb, void * VoidObject )
+{
+    fetchJob_t * job = static_cast<fetchJob_t *>( VoidObject );
+    unsigned int len = size * nmemb;
+    unsigned int vlen = 0;
+    const char * v;
+
+    // a new status line starts a new response (redirects); only the last one counts
+    if ( len > 5 && strncmp( buffer, "HTTP/", 5 ) == 0 ) {
+        job->resp_etag.erase();
+        job->resp_last_modified.erase();
+        job->max_age = -1;
+    }
+    else if ( (v = header_value( buffer, len, "Cache-Control", &vlen )) ) {
+        basicString_t cc;
+        cc.strncpy( v, vlen );
+        const char * ma = cc.stristr( "max-age=" );
+        if ( cc.stristr( "no-cache" ) || cc.stristr( "no-store" ) )
+            job->max_age = 0;
+        else if ( ma )
+            job->max_age = atoi( ma + 8 );
+    }
+    else if ( (v = header_value( buffer, len, "Expires", &vlen )) ) {
+        // Cache-Control wins when both are sent
+        if ( job->max_age < 0 ) {
+            basicString_t ex;
+            ex.strncpy( v, vlen );
+            time_t t = curl_getdate( ex.str, 0 );
+            if ( t > 0 )
+                job->max_age = t > time(0) ? (int)(t - time(0)) : 0;
+        }
+    }
+    else if ( (v = header_value( buffer, len, "ETag", &vlen )) ) {
+        job->resp_etag.erase();
+        job->resp_etag.append( v, vlen );
+    }
+    else if ( (v = header_value( buffer, len, "Last-Modified", &vlen )) ) {
+        job->resp_last_modified.erase();
+        job->resp_last_modified.append( v, vlen );
+    }
+
+    return size * nmemb;
+}
+
+// "http://user@host.com:8080/path" --> "host.com"
+static void host_from_url( const char * url, basicString_t& host )
+{
+    host.erase();
+    if ( !url || !*url )
+        return;
+
+    const char * p = strstr( url, "://" );
+    p = p ? p + 3 : url;
+
+    // skip credentials
+    const char * at = p;
+    while ( *at && *at != '/' && *at != '@' )
+        ++at;
+    if ( *at == '@' )
+        p = at + 1;
+
+    const char * e = p;
+    while ( *e && *e != '/' && *e != ':' && *e != '?' && *e != '#' )
+        ++e;
+
+    if ( e > p )
+        host.strncpy( p, e - p );
+    host.toLower();
+}
+
+
+/********************************************************************
+ *
+ * fetchContext_t
+ *
+ ********************************************************************/
+
+fetchContext_t::fetchContext_t() : share(0), idle()
+{
+    curl_global_init( CURL_GLOBAL_DEFAULT );
+
+    share = curl_share_init();
+    if ( share ) {
+        curl_share_setopt( share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS );
+        curl_share_setopt( share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION );
+        curl_share_setopt( share, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT );
+    }
+}
+
+fetchContext_t::~fetchContext_t()
+{
+    for ( unsigned int i = 0; i < idle.length(); i++ )
+        curl_easy_cleanup( idle[i] );
+    idle.reset();
+
+    if ( share )
+        curl_share_cleanup( share );
+    share = 0;
+
+    curl_global_cleanup();
+}
+
+CURL * fetchContext_t::getHandle()
+{
+    CURL * curl = idle.length() ? idle.pop() : curl_easy_init();
+    if ( !curl )
+        return 0;
+
+    if ( share )
+        curl_easy_setopt( curl, CURLOPT_SHARE, share );
+    curl_easy_setopt( curl, CURLOPT_NOSIGNAL, 1L );
+    return curl;
+}
+
+void fetchContext_t::returnHandle( CURL * curl )
+{
+    if ( !curl )
+        return;
+
+    // keeps its caches and live connections, only the options are cleared
+    curl_easy_reset( curl );
+    idle.add( curl );
+}
+
+
+/********************************************************************
+ *
+ * fetchEngine_t
+ *
+ ********************************************************************/
+
+fetchEngine_t::fetchEngine_t() : multi(0), context(0), jobs(), active(), nextJob(0), finished(0),
+    maxParallel(DEFAULT_FETCH_PARALLEL), maxPerHost(DEFAULT_FETCH_PER_HOST), timeout_sec(20), user_agent(), writeHook(0), writeArg(0), idleHook(0), idleArg(0), holdHook(0), holdArg(0)
+{
+    curl_global_init( CURL_GLOBAL_DEFAULT );
+    multi = curl_multi_init();
+}
+
+fetchEngine_t::fetchEngine_t( unsigned int parallel, unsigned int per_host, fetchContext_t * ctx ) : multi(0), context(ctx), jobs(), active(), nextJob(0), finished(0),
+    maxParallel(parallel ? parallel : 1), maxPerHost(per_host ? per_host : 1), timeout_sec(20), user_agent(), writeHook(0), writeArg(0), idleHook(0), idleArg(0), holdHook(0), holdArg(0)
+{
+    curl_global_init( CURL_GLOBAL_DEFAULT );
+    multi = curl_multi_init();
+}
+
+fetchEngine_t::~fetchEngine_t()
+{
+    clear();
+    if ( multi )
+        curl_multi_cleanup( multi );
+    multi = 0;
+
+    // curl counts these; pairs with the init in the constructor
+    curl_global_cleanup();
+}
+
+void fetchEngine_t::clear()
+{
+    for ( unsigned int i = 0; i < jobs.length(); i++ )
+    {
+        fetchJob_t * job = jobs[i];
+        if ( job->easy ) {
+            curl_multi_remove_handle( multi, job->easy );
+            releaseHandle( job->easy );
+        }
+        if ( job->headers )
+            curl_slist_free_all( job->headers );
+        delete job;
+    }
+    jobs.reset();
+    active.reset();
+    nextJob = 0;
+    finished = 0;
+}
+
+void fetchEngine_t::releaseHandle( CURL * curl )
+{
+    if ( context )
+        context->returnHandle( curl );
+    else
+        curl_easy_cleanup( curl );
+}
+
+fetchJob_t * fetchEngine_t::add( const char * url, int id, void * user )
+{
+    fetchJob_t * job = new fetchJob_t;
+    job->url = url;
+    job->id = id;
+    job->user = user;
+    job->write = writeHook;
+    job->write_arg = writeArg;
+    host_from_url( url, job->host );
+    jobs.add( job );
+    return job;
+}
+
+// how many are in flight against this host
+unsigned int fetchEngine_t::hostCount( const basicString_t& host )
+{
+    unsigned int n = 0;
+    for ( unsigned int i = 0; i < active.length(); i++ ) {
+        if ( active[i]->host.icompare( host ) )
+            ++n;
+    }
+    return n;
+}
+
+// first unstarted job whose host is under the per-host limit
+fetchJob_t * fetchEngine_t::nextStartable()
+{
+    while ( nextJob < jobs.length() && jobs[nextJob]->started )
+        ++nextJob;
+
+    for ( unsigned int i = nextJob; i < jobs.length(); i++ )
+    {
+        fetchJob_t * job = jobs[i];
+        if ( job->started || hostCount( job->host ) >= maxPerHost )
+            continue;
+        job->started = 1;
+        return job;
+    }
+    return 0;
+}
+
+int fetchEngine_t::startJob( fetchJob_t * job )
+{
+    CURL * curl = context ? context->getHandle() : curl_easy_init();
+    if ( !curl ) {
+        warning( "failure in curl_easy_init()\n" );
+        job->code = CURLE_FAILED_INIT;
+        return 0;
+    }
+
+    curl_easy_setopt( curl, CURLOPT_URL, job->url.str );
+    curl_easy_setopt( curl, CURLOPT_FOLLOWLOCATION, 1L );
+    curl_easy_setopt( curl, CURLOPT_WRITEFUNCTION, _storeJob );
+    curl_easy_setopt( curl, CURLOPT_WRITEDATA, job );
+    curl_easy_setopt( curl, CURLOPT_PRIVATE, job );
+    curl_easy_setopt( curl, CURLOPT_NOPROGRESS, 1L );
+    curl_easy_setopt( curl, CURLOPT_NOSIGNAL, 1L );
+    if ( user_agent.length() )
+        curl_easy_setopt( curl, CURLOPT_USERAGENT, user_agent.str );
+    curl_easy_setopt( curl, CURLOPT_TIMEOUT, (long) timeout_sec );
+    // "" offers every encoding curl was built with (gzip, deflate, br); decoded as it streams in
+    curl_easy_setopt( curl, CURLOPT_ACCEPT_ENCODING, "" );
+    curl_easy_setopt( curl, CURLOPT_HEADERFUNCTION, _storeHeader );
+    curl_easy_setopt( curl, CURLOPT_HEADERDATA, job );
+
+    // conditional GET
+    basicString_t h;
+    if ( job->etag.length() )
+        job->headers = curl_slist_append( job->headers, h.sprintf( "If-None-Match: %s", job->etag.str ).str );
+    if ( job->last_modified.length() )
+        job->headers = curl_slist_append( job->headers, h.sprintf( "If-Modified-Since: %s", job->last_modified.str ).str );
+    if ( job->headers )
+        curl_easy_setopt( curl, CURLOPT_HTTPHEADER, job->headers );
+
+    if ( curl_multi_add_handle( multi, curl ) != CURLM_OK ) {
+        releaseHandle( curl );
+        job->code = CURLE_FAILED_INIT;
+        return 0;
+    }
+
+    job->easy = curl;
+    active.add( job );
+    return 1;
+}
+
+void fetchEngine_t::finishJob( fetchJob_t * job, fetchDone_f done, void * arg )
+{
+    if ( job->easy )
+    {
+        curl_off_t wire = 0;
+        curl_easy_getinfo( job->easy, CURLINFO_RESPONSE_CODE, &job->http_code );
+        curl_easy_getinfo( job->easy, CURLINFO_SIZE_DOWNLOAD_T, &wire );
+        job->wire_bytes = wire;
+        curl_multi_remove_handle( multi, job->easy );
+        releaseHandle( job->easy );
+        job->easy = 0;
+
+        if ( job->headers )
+            curl_slist_free_all( job->headers );
+        job->headers = 0;
+
+        for ( unsigned int i = 0; i < active.length(); i++ ) {
+            if ( active[i] == job ) {
+                active[i] = active.getLast();
+                active.pop();
+                break;
+            }
+        }
+    }
+
+    // refill before the callback, so the network stays busy while caller works
+    fillSlots( done, arg );
+
+    reportJob( job, done, arg );
+}
+
+// counts it finished and hands it to the caller
+void fetchEngine_t::reportJob( fetchJob_t * job, fetchDone_f done, void * arg )
+{
+    ++finished;
+
+    if ( done )
+        done( job, arg );
+
+    // body no longer needed
+    job->data.clearMem();
+}
+
+void fetchEngine_t::fillSlots( fetchDone_f done, void * arg )
+{
+    while ( active.length() < maxParallel )
+    {
+        if ( holdHook && holdHook( holdArg ) )
+            break;
+
+        fetchJob_t * job = nextStartable();
+        if ( !job )
+            break;
+
+        // never started, so there's nothing to release. Reported directly,
+        //  not through finishJob(), so a run of bad urls doesn't recurse
+        if ( !startJob( job ) )
+            reportJob( job, done, arg );
+    }
+}
+
+int fetchEngine_t::run( fetchDone_f done, void * arg )
+{
+    int succeeded = 0;
+
+    if ( !multi )
+        return 0;
+
+    // the curl pool shouldn't open more than we would ever start
+    curl_multi_setopt( multi, CURLMOPT_MAX_HOST_CONNECTIONS, (long) maxPerHost );
+    curl_multi_setopt( multi, CURLMOPT_MAX_TOTAL_CONNECTIONS, (long) maxParallel );
+
+    fillSlots( done, arg );
+
+    while ( finished < jobs.length() )
+    {
+        int running = 0;
+        curl_multi_perform( multi, &running );
+
+        // collect completed transfers
+        CURLMsg * msg;
+        int left;
+        while ( (msg = curl_multi_info_read( multi, &left )) )
+        {
+            if ( msg->msg != CURLMSG_DONE )
+                continue;
+
+            fetchJob_t * job = 0;
+            curl_easy_getinfo( msg->easy_handle, CURLINFO_PRIVATE, (char **) &job );
+            if ( !job )
+                continue;
+
+            job->code = msg->data.result;
+            if ( job->code == CURLE_OK )
+                ++succeeded;
+
+            finishJob( job, done, arg );
+        }
+
+        int busy = idleHook ? idleHook( idleArg ) : 0;
+
+        // slots left empty while held
+        fillSlots( done, arg );
+
+        if ( finished >= jobs.length() )
+            break;
+
+        curl_multi_wait( multi, 0, 0, busy ? 10 : 1000, 0 );
+    }
+
+    return succeeded;
+}
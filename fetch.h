@@ -0,0 +1,216 @@
+/*
+======================================================================
+
+RSS Power Tool Source Code
+Copyright (C) 2013 Gregory Naughton
+
+This file is part of RSS Power Tool
+
+RSS Power Tool is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+RSS Power Tool is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with RSS Power Tool  If not, see <http://www.gnu.org/licenses/>.
+
+======================================================================
+*/
+
+// fetch.h
+#ifndef __FETCH_H__
+#define __FETCH_H__
+
+extern "C"
+{
+#include <curl/curl.h>
+} // extern "C"
+
+#include "datastruct.h"     // cppbuffer_t
+#include "misc.h"           // basicString_t
+
+
+#define DEFAULT_FETCH_PARALLEL      16
+#define DEFAULT_FETCH_PER_HOST      4
+
+
+struct fetchJob_t;
+
+// optional; gets the body as it arrives, in place of collecting it in job->data
+typedef void (*fetchWrite_f)( fetchJob_t *, const char *, unsigned int, void * );
+
+/********************************************************
+ *
+ *  fetchJob_t
+ *
+ *  - one url transfer; owned by fetchEngine_t
+ *
+ */
+struct fetchJob_t
+{
+    int             id;         // caller supplied, eg. feed.id
+    void *          user;       // caller supplied, passed back untouched
+    basicString_t   url;
+    basicString_t   host;       // scraped from url, for the per-host limit
+    basicString_t   data;       // response body
+
+    // validators from the last fetch, sent as If-None-Match / If-Modified-Since
+    basicString_t   etag;
+    basicString_t   last_modified;
+
+    // validators the server sent back this time
+    basicString_t   resp_etag;
+    basicString_t   resp_last_modified;
+
+    // seconds the server says the response stays fresh (Cache-Control max-age,
+    //  or Expires); -1 when it didn't say
+    int             max_age;
+
+    CURLcode        code;       // CURLE_OK on success
+    long            http_code;
+
+    // transfer size as compressed on the wire, and after decoding
+    long long       wire_bytes;
+    long long       decoded_bytes;
+
+    fetchWrite_f    write;
+    void *          write_arg;
+    void *          stream;     // caller's state for the write hook
+
+    CURL *          easy;       // only set while in flight
+    struct curl_slist * headers;
+    int             started;
+
+    fetchJob_t() : id(0), user(0), max_age(-1), code(CURLE_OK), http_code(0), wire_bytes(0), decoded_bytes(0), write(0), write_arg(0), stream(0), easy(0), headers(0), started(0)
+    { }
+
+    // server says our copy is current (conditional GET); there is no body
+    bool notModified() const { return code == CURLE_OK && http_code == 304; }
+};
+
+/********************************************************
+ *
+ *  fetchContext_t
+ *
+ *  - long-lived curl state. Keeps finished easy handles for reuse,
+ *    and shares DNS, TLS sessions and connections between every
+ *    handle it gives out, so repeated fetches from the same host
+ *    skip the lookup, handshake and connect.
+ *
+ */
+class fetchContext_t
+{
+protected:
+    CURLSH *                    share;
+    buffer_t<CURL*>             idle;
+
+public:
+
+    fetchContext_t();
+    virtual ~fetchContext_t();
+
+    // a handle attached to the share, with options from any previous use cleared
+    CURL * getHandle();
+
+    // give it back when the transfer is done, instead of curl_easy_cleanup()
+    void returnHandle( CURL * );
+};
+
+
+// called on the thread that calls fetchEngine_t::run(), once per job, as each finishes.
+//  Must not block: transfers only move while run() is looping
+typedef void (*fetchDone_f)( fetchJob_t *, void * );
+
+// called on the run() thread between rounds of transfers. Returns nonzero
+//  while it still has work waiting, so run() only waits briefly for the network
+typedef int (*fetchIdle_f)( void * );
+
+// called on the run() thread before starting a transfer. Nonzero holds off
+//  new transfers; the ones in flight carry on
+typedef int (*fetchHold_f)( void * );
+
+
+/********************************************************
+ *
+ *  fetchEngine_t
+ *
+ *  - runs many transfers at once on a curl multi handle. Jobs are
+ *    started in the order they were added, keeping no more than
+ *    maxParallel in flight overall, and no more than maxPerHost in
+ *    flight against any single host.
+ *
+ */
+class fetchEngine_t
+{
+protected:
+    CURLM *                     multi;
+    fetchContext_t *            context;    // handles come from here, if set
+
+    buffer_t<fetchJob_t*>       jobs;
+    buffer_t<fetchJob_t*>       active;     // in flight, at most maxParallel
+    unsigned int                nextJob;    // jobs before this have all been started
+    unsigned int                finished;
+
+    unsigned int                maxParallel;
+    unsigned int                maxPerHost;
+
+    int                         timeout_sec;
+    basicString_t               user_agent;
+
+    fetchWrite_f                writeHook;
+    void *                      writeArg;
+
+    fetchIdle_f                 idleHook;
+    void *                      idleArg;
+
+    fetchHold_f                 holdHook;
+    void *                      holdArg;
+
+    unsigned int hostCount( const basicString_t& );
+    fetchJob_t * nextStartable();
+    int startJob( fetchJob_t * );
+    void releaseHandle( CURL * );
+    void finishJob( fetchJob_t *, fetchDone_f, void * );
+    void reportJob( fetchJob_t *, fetchDone_f, void * );
+    void fillSlots( fetchDone_f, void * );
+
+public:
+
+    fetchEngine_t();
+    fetchEngine_t( unsigned int parallel, unsigned int per_host, fetchContext_t * ctx =0 );
+    virtual ~fetchEngine_t();
+
+    void setParallel( unsigned int n ) { maxParallel = n ? n : 1; }
+    void setPerHost( unsigned int n ) { maxPerHost = n ? n : 1; }
+    void setTimeout( int sec ) { timeout_sec = sec; }
+    void setUserAgent( const char * ua ) { user_agent = ua; }
+
+    // stream bodies to w as they download, for jobs added after this
+    void setWriteHook( fetchWrite_f w, void * arg =0 ) { writeHook = w; writeArg = arg; }
+
+    // run i between rounds of transfers
+    void setIdleHook( fetchIdle_f i, void * arg =0 ) { idleHook = i; idleArg = arg; }
+
+    // don't start anything new while h says so
+    void setHoldHook( fetchHold_f h, void * arg =0 ) { holdHook = h; holdArg = arg; }
+
+    // queue a url. Nothing is fetched until run()
+    fetchJob_t * add( const char * url, int id =0, void * user =0 );
+
+    unsigned int count() const { return jobs.length(); }
+
+    // blocks until every queued job has finished, calling done() for each
+    //  in the order they complete. Returns the number that succeeded.
+    int run( fetchDone_f done, void * arg =0 );
+
+    // frees all jobs, engine can be reused
+    void clear();
+};
+
+
+#endif /* __FETCH_H__ */
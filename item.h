@@ -0,0 +1,111 @@
+/*
+======================================================================
+
+RSS Power Tool Source Code
+Copyright (C) 2013 Gregory Naughton
+
+This file is part of RSS Power Tool
+
+RSS Power Tool is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+RSS Power Tool is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with RSS Power Tool  If not, see <http://www.gnu.org/licenses/>.
+
+======================================================================
+*/
+
+// item.h
+#ifndef __ITEM_H__
+#define __ITEM_H__
+
+#include "misc.h"           // basicString_t
+#include "sha1.h"
+
+struct Item_t
+{
+    int feed_id;
+    basicString_t title;
+    basicString_t description;
+    basicString_t pubDate;
+    basicString_t sqldate;
+    basicString_t media_url;
+    basicString_t item_url;
+    basicString_t content;
+    basicString_t author;
+    basicString_t hash;
+
+    void clear() {
+        feed_id = 0;
+        title.set( "" );
+        description.set( "" );
+        pubDate.set( "" );
+        sqldate.erase();
+        media_url.set( "" );
+        item_url.set( "" );
+        content.erase();
+        author.erase();
+        hash.erase();
+    }
+
+    void trim() {
+        title.trim();
+        description.trim();
+        pubDate.trim();
+        sqldate.trim();
+        media_url.trim();
+        item_url.trim();
+        content.trim();
+        author.trim();
+    }
+
+
+    // generate and store internally
+    void gen_hash() {
+        this->hash = this->get_hash();
+    }
+
+private:
+    // *see have_item() for notes on exact hash heuristic
+    const char * get_hash()
+    {
+        basicString_t buf;
+
+        int x_count = (sqldate.length()!=0u) + (title.length()!=0u) + (media_url.length()!=0u||item_url.length()!=0u);
+        switch ( x_count )
+        {
+        case 3:
+            buf = sqldate.substr(0,10).str;
+            buf += title;
+            buf += media_url;
+            buf += item_url;
+            break;
+        case 2:
+            buf.sprintf( "%d", feed_id );
+            if ( sqldate.length() )
+                buf += sqldate.substr(0,10).str;
+            if ( title.length() )
+                buf += title;
+            if ( media_url.length() )
+                buf += media_url;
+            if ( item_url.length() )
+                buf += item_url;
+            break;
+        default:
+            return 0; // no hash, unique item
+            break;
+        }
+
+        return SHA1_BlockSumPrintable( buf.str, buf.length() ) ;
+    }
+};
+
+
+#endif /* __ITEM_H__ */
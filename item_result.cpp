@@ -27,74 +27,302 @@ along with RSS Power Tool  If not, see <http://www.gnu.org/licenses/>.
 //
 // query a slice of results from ( page_start to page_start+limitSz )
 // slices are of size limitSz, except for the last one
-// store in linked-list. so we only get slices that are accessed
+// pages are fetched as they're accessed, and the least recently used
+//  are let go once there are more than maxResident
 // 
 DBResult * ItemResult::inlineQuery( unsigned int page_start )
 {
-    basicString_t buf;
+    unsigned int p = page_start / limitSz;
+    growPages( p + 1 );
+
     basicString_t query;
-    query.sprintf( "select%sfeed.title as ftitle,feed_id,item.* from item,item_feeds,feed where item_feeds.item_id = item.id and item_feeds.feed_id = feed.id", distinct ? " distinct " : " " ); 
+    buildQuery( p, query );
+
+    DBResult * res = DB->queryUnsaved( query.str );
+    if ( !res )
+        res = new DBResult;
+
+    install( p, res );
+    return res;
+}
+
+// the select for page p
+void ItemResult::buildQuery( unsigned int p, basicString_t& query )
+{
+    // start from the nearest page before this one whose end is known, and
+    //  count through whatever pages lie between. Scrolling, that's none
+    unsigned int skip = p;
+    const char * after = 0;
+    for ( unsigned int q = p; q > 0; q-- ) {
+        if ( pages[q-1].after.length() ) {
+            after = pages[q-1].after.str;
+            skip = p - q;
+            break;
+        }
+    }
+
+    query.sprintf( "select%sfeed.title as ftitle,feed_id,%sitem.* from item,item_feeds,feed where item_feeds.item_id = item.id and item_feeds.feed_id = feed.id", distinct ? " distinct " : " ", use_priority ? "feed.priority as fpriority," : "" ); 
     // conditional
     if ( clause.length() ) {
         query += " and ";
         query += clause;
     }
+    if ( after ) {
+        query += " and ";
+        query += after;
+    }
 
-    // finish
-    query += buf.sprintf( " order by %s %s %s limit %u offset %u;", use_priority ? "priority desc," : "", field.str, sort.str, limitSz, page_start );
-    DBResult * res = DB->query( query.str );
+    // finish. item and feed ids make every row's key unique, so no row
+    //  is on both sides of a page boundary
+    query.appendf( " order by %s%s %s, item.id %s, item_feeds.feed_id %s limit %u", use_priority ? "feed.priority desc," : "", field.str, sort.str, sort.str, sort.str, limitSz );
+    if ( skip )
+        query.appendf( " offset %u", skip * limitSz );
+    query += ";";
+}
 
+// res becomes page p, and the most recently used
+void ItemResult::install( unsigned int p, DBResult * res )
+{
+    if ( pages[p].res )
+        delete pages[p].res;
+    else
+        ++resident;
+    pages[p].res = res;
+    touch( p );
 
-    // alocate holder and set
-    node_t<res_t> * res_p = results.allocate();
-    res_p->val.set( page_start, res );
-    
-    // insert into list
-    if ( results.size() == 0 ) { // empty list
-        results.insertAfter( res_p );
-        return res;
+    if ( res->numRows() == limitSz )
+        setAfter( p, res );
+
+    while ( resident > maxResident )
+        evict();
+}
+
+// one column of the sort key, given its value in the last row of a page:
+//  sql for the rows strictly past it, and for the rows level with it
+static void keyAfter( const char * col, DBValue * v, bool desc, basicString_t& past, basicString_t& level )
+{
+    basicString_t val;
+    bool null = !v || v->isNull();
+
+    if ( !null ) {
+        if ( v->type() == SQLITE_INTEGER )
+            val.sprintf( "%lld", v->getInt64() );
+        else if ( v->type() == SQLITE_FLOAT )
+            val.sprintf( "%.17g", v->getFloat() );
+        else {
+            basicString_t text( v->getString() );
+            text.replace( "'", "''" );
+            val.sprintf( "'%s'", text.str );
+        }
     }
-    
-    node_t<res_t> * node = results.gethead();
-
-    // insert before head
-    if ( page_start < node->val.index ) {
-        results.insertAfter( res_p, 0 );
-        return res;
-    } 
-
-    node = results.gettail();
-    
-    while ( node && page_start < node->val.index ) 
+
+    // nulls sort lowest
+    if ( null ) {
+        past.sprintf( desc ? "0" : "%s is not null", col );
+        level.sprintf( "%s is null", col );
+    } else {
+        if ( desc )
+            past.sprintf( "(%s < %s or %s is null)", col, val.str, col );
+        else
+            past.sprintf( "%s > %s", col, val.str );
+        level.sprintf( "%s = %s", col, val.str );
+    }
+}
+
+// where clause for the rows that follow page p, from its last row:
+//  past the first key, or level with it and past the second, and so on
+void ItemResult::setAfter( unsigned int p, DBResult * res )
+{
+    DBRow & row = res->getRow( res->numRows() - 1 );
+    bool desc = sort.icompare( "desc" );
+
+    basicString_t col( "item." );
+    col += field;
+
+    const char * cols[] = { "feed.priority", col.str, "item.id", "item_feeds.feed_id" };
+    const char * names[] = { "fpriority", field.str, "id", "feed_id" };
+    bool descs[] = { true, desc, desc, desc };
+    int first = use_priority ? 0 : 1;
+
+    basicString_t past, level, tail;
+    basicString_t& out = pages[p].after;
+    for ( int k = 3; k >= first; k-- )
     {
-        node = node->prev;
+        keyAfter( cols[k], row.FindByName( names[k] ), descs[k], past, level );
+        if ( k == 3 )
+            out.sprintf( "(%s)", past.str );
+        else {
+            tail = out;
+            out.sprintf( "(%s or (%s and %s))", past.str, level.str, tail.str );
+        }
     }
+}
+
+void ItemResult::growPages( unsigned int n )
+{
+    if ( n <= npages )
+        return;
 
-    results.insertAfter( res_p, node );
+    unsigned int cap = npages ? npages : 16;
+    while ( cap < n )
+        cap *= 2;
 
-    return res;
+    page_t * grown = new page_t[ cap ];
+    for ( unsigned int i = 0; i < npages; i++ ) {
+        grown[i].res = pages[i].res;
+        grown[i].prev = pages[i].prev;
+        grown[i].next = pages[i].next;
+        grown[i].after = pages[i].after;
+    }
+    delete[] pages;
+    pages = grown;
+    npages = cap;
+}
+
+void ItemResult::unlink( unsigned int p )
+{
+    page_t& pg = pages[p];
+    if ( pg.prev != -1 )
+        pages[ pg.prev ].next = pg.next;
+    else if ( lru_head == (int) p )
+        lru_head = pg.next;
+    if ( pg.next != -1 )
+        pages[ pg.next ].prev = pg.prev;
+    else if ( lru_tail == (int) p )
+        lru_tail = pg.prev;
+    pg.prev = pg.next = -1;
+}
+
+// to the front of the lru list
+void ItemResult::touch( unsigned int p )
+{
+    if ( lru_head == (int) p )
+        return;
+    unlink( p );
+    pages[p].next = lru_head;
+    if ( lru_head != -1 )
+        pages[ lru_head ].prev = p;
+    lru_head = p;
+    if ( lru_tail == -1 )
+        lru_tail = p;
+}
+
+// drop the least recently used page; its boundary stays
+void ItemResult::evict()
+{
+    if ( lru_tail == -1 )
+        return;
+    unsigned int p = lru_tail;
+    unlink( p );
+    delete pages[p].res;
+    pages[p].res = 0;
+    --resident;
+}
+
+void ItemResult::freePages()
+{
+    for ( unsigned int i = 0; i < npages; i++ ) {
+        if ( pages[i].res )
+            delete pages[i].res;
+    }
+    delete[] pages;
+    pages = 0;
+    npages = 0;
+    lru_head = lru_tail = -1;
+    resident = 0;
+    totalRows = 0;
+
+    // whatever the worker is on now is for the old pages
+    ++generation;
+    lastPage = -1;
 }
 
 // 
 DBRow & ItemResult::operator[]( unsigned int index )
 {
-    if ( !results.size() ) {
-        DBResult * res = inlineQuery( (index/limitSz) * limitSz );
-        return (*res)[ index % limitSz ];
+    unsigned int p = index / limitSz;
+
+    // the worker may have it, or be about to
+    if ( out && !( p < npages && pages[p].res ) )
+        collect( pending == (int) p );
+
+    DBResult * res;
+    if ( p < npages && pages[p].res ) {
+        touch( p );
+        res = pages[p].res;
+    } else {
+        // not resident, get results from query
+        res = inlineQuery( p * limitSz );
     }
 
-    // look for result page
-    node_t<res_t> * node = results.gethead();
-    while ( node ) 
-    {
-        if ( index >= node->val.index && index < node->val.index + limitSz )
-            return node->val.res->getRow( index - node->val.index );
-        node = node->next;
+    // a page turn gives the direction to read ahead in
+    if ( lastPage != -1 && (int) p != lastPage ) {
+        if ( (int) p > lastPage )
+            schedule( p + 1 );
+        else if ( p > 0 )
+            schedule( p - 1 );
     }
+    lastPage = p;
 
-    // not found, get results from query
-    DBResult * res = inlineQuery( (index/limitSz) * limitSz );
-    return res->getRow( index % limitSz );
+    return res->getRow( index - p * limitSz );
+}
+
+// ask the worker for page p, unless it's here already or another is out
+void ItemResult::schedule( unsigned int p )
+{
+    if ( !prefetch || !DB )
+        return;
+    if ( out ) {
+        collect( false );
+        if ( out )
+            return;
+    }
+    if ( (unsigned long long) p * limitSz >= numRows() )
+        return;
+    if ( p < npages && pages[p].res )
+        return;
+
+    DBBackground * bg = DB->background();
+    if ( !bg ) {
+        prefetch = 0;
+        return;
+    }
+
+    growPages( p + 1 );
+
+    basicString_t sql;
+    buildQuery( p, sql );
+    out = bg->submit( sql.str );
+    pending = p;
+    pendingGen = generation;
+}
+
+// take in the page that's out, if it's done; waiting for it if asked to
+void ItemResult::collect( bool wait )
+{
+    DBResult * res = 0;
+    if ( !DB->background()->collect( out, wait, &res ) )
+        return;
+    out = 0;
+
+    // dropped while it was out, or already fetched some other way
+    unsigned int p = (unsigned int) pending;
+    pending = -1;
+    if ( pendingGen == generation && res && p < npages && !pages[p].res ) {
+        install( p, res );
+        res = 0;
+    }
+    delete res;
+}
+
+// let go of the page that's out
+void ItemResult::stopPrefetch()
+{
+    if ( !out )
+        return;
+    DB->background()->cancel( out );
+    out = 0;
+    pending = -1;
 }
 
 
@@ -120,3 +348,13 @@ unsigned int ItemResult::numRows()
     return totalRows;
 }
 
+int ItemResult::colIndex( strView_t name )
+{
+    if ( lru_head == -1 ) {
+        if ( 0 == numRows() )
+            return -1;
+        (*this)[0]; // fetch the first page
+    }
+    DBResult * res = pages[ lru_head ].res;
+    return res ? res->colIndex( name ) : -1;
+}
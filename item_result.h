@@ -26,26 +26,30 @@ along with RSS Power Tool  If not, see <http://www.gnu.org/licenses/>.
 #define __ITEM_RESULT_H__
 
 #define DEFAULT_QUERY_LIMIT 200
+#define DEFAULT_RESIDENT_PAGES 16   // pages kept in memory; the least recently used go first
 
 #include "dba_sqlite.h"
 #include "misc.h"
 
 // overloads row mechanism, so that if the indices is out of the size bound,
 //  a new query is made inline, 
+//
+// pages are found by number, and each one fetched leaves behind the sort key
+//  of its last row. The next page starts where that leaves off, with a where
+//  clause the sort index can seek to, rather than an offset sqlite has to
+//  count through. Only the most recently used pages stay in memory
 class ItemResult : public result_t
 {
 protected:
     
-    struct res_t {
-        unsigned int index;
-        DBResult * res;
-        res_t() : index(0), res(0) { }
-        void set( unsigned int i, DBResult * r ) { index = i; res = r; }
-        ~res_t() { res = 0; }
+    struct page_t {
+        DBResult * res;         // 0 when not resident
+        int prev, next;         // lru order, by page number; -1 ends
+        basicString_t after;    // sql matching the rows after this page; empty until known
+        page_t() : res(0), prev(-1), next(-1) { }
     };
 
     // no init
-    list_t<res_t> results;
     basicString_t clause;   // client where clause, optional
 
     // init
@@ -59,27 +63,58 @@ protected:
     int distinct;
     int use_priority;
 
+    page_t * pages;         // by page number
+    unsigned int npages;
+    int lru_head, lru_tail; // most and least recently used
+    unsigned int resident;
+    unsigned int maxResident;
+
+    // read ahead on DB's background() worker, shared with every other
+    //  ItemResult; at most one page out at a time
+    DBRequest * out;
+    int prefetch;           // 0 when off, or there's no worker for it
+    int pending;            // page that's out, -1 when none
+    unsigned int pendingGen; // generation it was asked for in
+    unsigned int generation; // bumped when the pages are dropped
+    int lastPage;           // last one asked for, for the direction of travel
 
     DBResult * inlineQuery( unsigned int );
-    
+    void buildQuery( unsigned int, basicString_t& );
+    void install( unsigned int, DBResult * );
+
+    void growPages( unsigned int );
+    void touch( unsigned int );
+    void unlink( unsigned int );
+    void evict();
+    void setAfter( unsigned int, DBResult * );
+    void freePages();
+
+    void schedule( unsigned int );
+    void collect( bool );
+    void stopPrefetch();
+
+    // not copyable
+    ItemResult( const ItemResult& );
+    ItemResult& operator=( const ItemResult& );
 
 public:
 
-    ItemResult() : totalRows(0), DB(0), limitSz(DEFAULT_QUERY_LIMIT), field("sqldate"), sort("desc"), distinct(0), use_priority(0)
+    ItemResult() : totalRows(0), DB(0), limitSz(DEFAULT_QUERY_LIMIT), field("sqldate"), sort("desc"), distinct(0), use_priority(0), pages(0), npages(0), lru_head(-1), lru_tail(-1), resident(0), maxResident(DEFAULT_RESIDENT_PAGES), out(0), prefetch(1), pending(-1), pendingGen(0), generation(0), lastPage(-1)
     { }
 
-    ItemResult( DBSqlite * db ) : totalRows(0), DB(db), limitSz(DEFAULT_QUERY_LIMIT), field( "sqldate"), sort("desc"), distinct(0), use_priority(0)
+    ItemResult( DBSqlite * db ) : totalRows(0), DB(db), limitSz(DEFAULT_QUERY_LIMIT), field( "sqldate"), sort("desc"), distinct(0), use_priority(0), pages(0), npages(0), lru_head(-1), lru_tail(-1), resident(0), maxResident(DEFAULT_RESIDENT_PAGES), out(0), prefetch(1), pending(-1), pendingGen(0), generation(0), lastPage(-1)
     { }
 
-    ItemResult( DBSqlite * db, unsigned int _lim ) : totalRows(0), DB(db), limitSz(_lim), field( "sqldate"), sort("desc"), distinct(0), use_priority(0)
+    ItemResult( DBSqlite * db, unsigned int _lim ) : totalRows(0), DB(db), limitSz(_lim), field( "sqldate"), sort("desc"), distinct(0), use_priority(0), pages(0), npages(0), lru_head(-1), lru_tail(-1), resident(0), maxResident(DEFAULT_RESIDENT_PAGES), out(0), prefetch(1), pending(-1), pendingGen(0), generation(0), lastPage(-1)
     { }
 
     virtual ~ItemResult() {
-        // erase these to make sure they're left alone
+        stopPrefetch();
+        freePages();
         DB = 0; 
     }
 
-    void setDBHandle( DBSqlite * db ) { DB = db; }
+    void setDBHandle( DBSqlite * db ) { stopPrefetch(); DB = db; }
 
 
     // indexing out of range triggers further queries until index is met, 
@@ -90,13 +125,22 @@ public:
     // total items as if this where a full query
     unsigned int numRows(); 
 
-    // 
-    void setClause( const char * str ) { clause = str; }
+    // every page is the same query, so any page's columns will do
+    int colIndex( strView_t );
+
+    // changing the query drops what was fetched for the old one
+    void setClause( const char * str ) { if ( !clause.compare( str ) ) freePages(); clause = str; }
     basicString_t& getClause() { return clause; }
 
-    void setDistinct(int d=1) { distinct = d; }
+    void setDistinct(int d=1) { if ( d != distinct ) freePages(); distinct = d; }
+
+    void usePriority(int d=1) { if ( d != use_priority ) freePages(); use_priority = d; }
+
+    // at least 2
+    void setMaxResident( unsigned int n ) { maxResident = n < 2 ? 2 : n; }
 
-    void usePriority(int d=1) { use_priority = d; }
+    // on by default
+    void setPrefetch( int d=1 ) { if ( !d ) stopPrefetch(); prefetch = d; }
 };
 
 #endif /* __ITEM_RESULT_H__ */
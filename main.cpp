@@ -39,6 +39,8 @@ along with RSS Power Tool  If not, see <http://www.gnu.org/licenses/>.
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <time.h>
+#include <pthread.h>
+#include <utility> // std::move
 
 #include "tinyxml2.h"
 using namespace tinyxml2;
@@ -57,6 +59,10 @@ extern "C"
 #include "quicksort.h"
 #include "curseview.h"
 #include "item_result.h"
+#include "fetch.h"
+#include "item.h"
+#include "feed_parser.h"
+#include "bloom.h"
 
 
 #define RSS_OPML_TITLE_STRING       "RSS Command Line Feed Reader - Feeds Export"
@@ -75,6 +81,12 @@ basicString_t config_dir;
 basicString_t config_path; // '<config_dir>/config'
 basicString_t db_fullpath_explicit; // overrides regular detection. exit returning error if not valid db
 DBSqlite DBA; // db handle
+fetchContext_t fetch_context; // reused curl handles, shared dns/tls/connection caches
+bloomFilter_t known_hashes; // every item.hash, so most new items skip the db lookup
+bool known_hashes_changed = false;
+long long known_hashes_count = 0;   // count(hash) and max(id) of the items the filter holds;
+long long known_hashes_high = 0;    //  only this process's own inserts move them. high is -1 after a delete
+bool have_search_index = false; // item_fts exists; sqlite may lack fts5
 basicString_t username;
 basicString_t system_name;
 stringbuffer_t cmd_args;
@@ -102,6 +114,9 @@ unsigned int update_title_len = 32;
 bool enable_dashed_line = true;
 char dashed_line_char = 0;
 int feed_timeouts_limit = 5;
+unsigned int fetch_parallel = DEFAULT_FETCH_PARALLEL;
+unsigned int fetch_per_host = DEFAULT_FETCH_PER_HOST;
+unsigned int parse_threads = 0; // 0: one per cpu, up to 8
 
 basicString_t pager_path;
 basicString_t browser_path;
@@ -310,7 +325,7 @@ Also, just keep pubDate, and insert fixed_date in a separate field
 */
 static const char * get_sqldate( basicString_t& base )
 {
-    static basicString_t out;
+    static thread_local basicString_t out; // called from the update parse pool
     out.erase();
 
     if ( base.length() == 0 )
@@ -418,7 +433,7 @@ static const char * get_sqldate( basicString_t& base )
 
 const char * sqldate_now()
 {
-    static basicString_t out;
+    static thread_local basicString_t out;
     struct tm s;
     time_t epoch = time(0);
     localtime_r( &epoch, &s );
@@ -820,84 +835,6 @@ struct Feed_t
     { }
 };
 
-struct Item_t
-{
-    int feed_id;
-    basicString_t title;
-    basicString_t description;
-    basicString_t pubDate;
-    basicString_t sqldate;
-    basicString_t media_url;
-    basicString_t item_url;
-    basicString_t content;
-    basicString_t author;
-    basicString_t hash;
-
-    void clear() {
-        feed_id = 0;
-        title.set( "" );
-        description.set( "" );
-        pubDate.set( "" );
-        sqldate.erase();
-        media_url.set( "" );
-        item_url.set( "" );
-        content.erase();
-        author.erase();
-        hash.erase();
-    }
-
-    void trim() {
-        title.trim();
-        description.trim();
-        pubDate.trim();
-        sqldate.trim();
-        media_url.trim();
-        item_url.trim();
-        content.trim();
-        author.trim();
-    }
-
-
-    // generate and store internally
-    void gen_hash() {
-        this->hash = this->get_hash();
-    }
-
-private:
-    // *see have_item() for notes on exact hash heuristic
-    const char * get_hash()
-    {
-        basicString_t buf;
-
-        int x_count = (sqldate.length()!=0u) + (title.length()!=0u) + (media_url.length()!=0u||item_url.length()!=0u);
-        switch ( x_count )
-        {
-        case 3:
-            buf = sqldate.substr(0,10).str;
-            buf += title;
-            buf += media_url;
-            buf += item_url;
-            break;
-        case 2:
-            buf.sprintf( "%d", feed_id );
-            if ( sqldate.length() )
-                buf += sqldate.substr(0,10).str;
-            if ( title.length() )
-                buf += title;
-            if ( media_url.length() )
-                buf += media_url;
-            if ( item_url.length() )
-                buf += item_url;
-            break;
-        default:
-            return 0; // no hash, unique item
-            break;
-        }
-
-        return SHA1_BlockSumPrintable( buf.str, buf.length() ) ;
-    }
-};
-
 struct FeedBuffer_t : public cppbuffer_t<Feed_t*>
 {
     FeedBuffer_t()
@@ -1178,7 +1115,14 @@ int CreateDB()
         errmsg TEXT,                            \
         disabled char(1) default 0,             \
         priority INTEGER default 5,             \
-        time_reading REAL default 0.0           \
+        time_reading REAL default 0.0,          \
+        etag TEXT,                              \
+        last_modified TEXT,                     \
+        bytes_wire INTEGER default 0,           \
+        bytes_decoded INTEGER default 0,        \
+        next_due INTEGER default 0,             \
+        poll_interval INTEGER default 0,        \
+        skip_hours INTEGER default 0            \
         );",
 
         "CREATE TABLE item (                    \
@@ -1229,6 +1173,8 @@ int CreateDB()
         comment TEXT                            \
         );",
 
+        /* indexes come from the migrations in upgrade_db(), which run next */
+
         "insert into keyvalue values(NULL,'numdeleted','0','int; item deleted count. vacuum resets count.');",
         "insert into keyvalue values(NULL,'bookmarks_changed','0','intbool; set to 1 when bookmark is added or deleted so it knows theres been a change. When bookmarks are resaved it sets to 0.');",
 
@@ -1267,6 +1213,221 @@ int CreateDB()
     return 0;
 }
 
+// hash every item that doesn't have one, the same way gen_hash() does for new items
+static void backfill_item_hashes()
+{
+    DBResult * res = DBA( "select item.id, title, sqldate, media_url, item_url, min(item_feeds.feed_id) as feed_id from item left join item_feeds on item_feeds.item_id = item.id where item.hash is null or item.hash = '' group by item.id;" );
+    if ( !res || res->numRows() == 0 )
+        return;
+
+    basicString_t query;
+    Item_t item;
+    const char * s;
+    int hashed = 0;
+
+    // the migration it runs from holds a transaction open
+    DBRow * row;
+    while ( (row = res->NextRow()) )
+    {
+        item.clear();
+        item.title = (s = row->getString( "title" )) ? s : "";
+        item.sqldate = (s = row->getString( "sqldate" )) ? s : "";
+        item.media_url = (s = row->getString( "media_url" )) ? s : "";
+        item.item_url = (s = row->getString( "item_url" )) ? s : "";
+        item.feed_id = row->getInt( "feed_id" );
+
+        item.gen_hash();
+        if ( item.hash.length() == 0 )
+            continue; // not enough to go on; these are always unique
+
+        DBA( query.sprintf( "update item set hash = '%s' where id = %d;", item.hash.str, row->getInt( "id" ) ).str );
+        ++hashed;
+    }
+
+    if ( hashed )
+        printf( "hashed %d older item%s\n", hashed, hashed > 1 ? "s" : "" );
+}
+
+//
+// schema migrations
+//
+// keyvalue 'schema_version' is the last one applied; a database without it
+//  is at 0, new ones included. Each runs once, in order, in a transaction.
+//  Steps check before they change anything, so databases that got part of
+//  the way under older versions, before there were versions, come through.
+//  Add new ones to the end; never change one that has shipped
+//
+
+// feed columns added over time
+static void migrate_feed_columns()
+{
+    // http validators for conditional GET
+    if ( !DBA.columnExists( "feed", "etag" ) )
+        DBA( "alter table feed add column etag TEXT;" );
+    if ( !DBA.columnExists( "feed", "last_modified" ) )
+        DBA( "alter table feed add column last_modified TEXT;" );
+
+    // size of the last download, compressed and decoded
+    if ( !DBA.columnExists( "feed", "bytes_wire" ) )
+        DBA( "alter table feed add column bytes_wire INTEGER default 0;" );
+    if ( !DBA.columnExists( "feed", "bytes_decoded" ) )
+        DBA( "alter table feed add column bytes_decoded INTEGER default 0;" );
+
+    // polling schedule
+    if ( !DBA.columnExists( "feed", "next_due" ) )
+        DBA( "alter table feed add column next_due INTEGER default 0;" );
+    if ( !DBA.columnExists( "feed", "poll_interval" ) )
+        DBA( "alter table feed add column poll_interval INTEGER default 0;" );
+    if ( !DBA.columnExists( "feed", "skip_hours" ) )
+        DBA( "alter table feed add column skip_hours INTEGER default 0;" );
+}
+
+// dedup by hash. Items from before hashes were kept get one first
+static void migrate_item_hashes()
+{
+    DBResult * res = DBA( "select name from sqlite_master where type = 'index' and name = 'item_hash';" );
+    if ( !res || res->numRows() == 0 )
+        backfill_item_hashes();
+
+    // have_item() looks items up by hash, then checks their feeds
+    DBA( "create index if not exists item_hash on item(hash);" );
+    DBA( "create index if not exists item_feeds_item_feed on item_feeds(item_id,feed_id);" );
+}
+
+// the joins and sorts that show, list, dump and update run
+static void migrate_query_indexes()
+{
+    // a feed's items: show, dump, rm, the poll scheduler
+    DBA( "create index if not exists item_feeds_feed_item on item_feeds(feed_id,item_id);" );
+    // everything sorted by date
+    DBA( "create index if not exists item_sqldate on item(sqldate);" );
+    // bookmark sync matches items by title
+    DBA( "create index if not exists item_title on item(title);" );
+    DBA( "create index if not exists saved_links_item on saved_links(item_id);" );
+    DBA( "create index if not exists reports_update_time on reports(update_time);" );
+}
+
+// full-text index over item for rss search. External content: the text
+//  stays in item, and insert_item() and delete_item() keep it in step.
+//  0 if this sqlite has no fts5
+static int build_search_index()
+{
+    DBResult * res = DBA( "select sqlite_compileoption_used('ENABLE_FTS5') as fts5;" );
+    DBValue * v = res ? res->FindByNameFirstRow( "fts5" ) : 0;
+    if ( !v || !v->getInt() )
+        return 0;
+
+    // a new database has nothing to index yet
+    res = DBA( "select id from item limit 1;" );
+    if ( res && res->numRows() > 0 )
+        printf( "building search index\n" );
+
+    DBA( "create virtual table if not exists item_fts using fts5(title, description, content, author, content='item', content_rowid='id');" );
+    DBA( "insert into item_fts(item_fts) values('rebuild');" );
+    return 1;
+}
+
+// without fts5 the step still counts; upgrade_db() builds the index on a
+//  later run, once sqlite has it
+static void migrate_search_index()
+{
+    if ( !build_search_index() )
+        printf( "sqlite was built without fts5; rss search will scan items\n" );
+}
+
+// failed fetches in a row, http errors included; the poll backoff grows with it
+static void migrate_feed_failures()
+{
+    if ( !DBA.columnExists( "feed", "failures" ) )
+        DBA( "alter table feed add column failures INTEGER default 0;" );
+}
+
+#define SCHEMA_SEARCH_INDEX     4   // version from which item_fts is wanted
+
+struct migration_t {
+    const char *    what;
+    void            (*run)();
+};
+
+static const migration_t migrations[] = {
+    { "feed columns", migrate_feed_columns },                   // 1
+    { "item hashes", migrate_item_hashes },                     // 2
+    { "indexes for joins and sorts", migrate_query_indexes },   // 3
+    { "search index", migrate_search_index },                   // 4 SCHEMA_SEARCH_INDEX
+    { "feed failure count", migrate_feed_failures },            // 5
+    { 0, 0 }
+};
+
+static int schema_version()
+{
+    DBResult * res = DBA( "select value from keyvalue where key = 'schema_version';" );
+    DBValue * v = res ? res->FindByNameFirstRow( "value" ) : 0;
+    return v ? v->getInt() : 0;
+}
+
+static void set_schema_version( int version )
+{
+    basicString_t buf;
+    DBResult * res = DBA( buf.sprintf( "update keyvalue set value = '%d' where key = 'schema_version';", version ).str );
+    if ( res && res->rowsUpdated() > 0 )
+        return;
+    DBA( buf.sprintf( "insert into keyvalue values(NULL,'schema_version','%d','int; last schema migration applied. see upgrade_db()');", version ).str );
+}
+
+// bring databases made by older versions up to the current schema. A step
+//  that fails is rolled back and not recorded, so it runs again next time
+static void upgrade_db()
+{
+    const int known = (int)( sizeof(migrations) / sizeof(migrations[0]) ) - 1;
+    int version = schema_version();
+
+    // written by a newer rss, eg. before a downgrade; leave it be
+    if ( version > known )
+        warning( "database schema version %d is newer than this rss knows (%d)\n", version, known );
+    if ( version < 0 )
+        version = 0;
+    int reached = version;
+
+    for ( int i = version; i < known; i++ )
+    {
+        if ( version > 0 )
+            printf( "upgrading database: %s\n", migrations[i].what );
+
+        unsigned int errors = DBA.errorCount();
+        DBA.BeginTransaction();
+        migrations[i].run();
+        set_schema_version( i + 1 );
+
+        if ( DBA.errorCount() != errors ) {
+            DBA.Rollback();
+            warning( "upgrading database failed at \"%s\": %s. Rolled back, will try again next run\n", migrations[i].what, DBA.errorMessage() );
+            break;
+        }
+        DBA.Commit();
+        reached = i + 1;
+    }
+
+    DBResult * res = DBA( "select name from sqlite_master where type = 'table' and name = 'item_fts';" );
+    have_search_index = res && res->numRows() > 0;
+
+    // the search index step ran under an sqlite without fts5; see if this one has it
+    if ( !have_search_index && reached >= SCHEMA_SEARCH_INDEX )
+    {
+        unsigned int errors = DBA.errorCount();
+        DBA.BeginTransaction();
+        if ( !build_search_index() )
+            DBA.Commit();
+        else if ( DBA.errorCount() != errors ) {
+            DBA.Rollback();
+            warning( "building search index failed: %s. Will try again next run\n", DBA.errorMessage() );
+        }
+        else {
+            DBA.Commit();
+            have_search_index = true;
+        }
+    }
+}
+
 static int try_setup_explicit_db()
 {
     if ( !db_fullpath_explicit.str || !*db_fullpath_explicit.str )
@@ -1315,6 +1476,10 @@ static void write_default_config()
     // curl
     conf += "# Curl timeout seconds (default 20) \n# curl_timeout_sec = 20\n\n";
 
+    // concurrent fetching
+    conf += "# Number of feeds fetched at once during update, and the most fetched at once\n# from any single host\n# fetch_parallel = 16\n# fetch_per_host = 4\n\n";
+    conf += "# Threads parsing feeds during update (default: one per cpu, up to 8)\n# parse_threads = 4\n\n";
+
     // speed
     conf += "# Default slideshow speed (seconds)\n# slideshow_speed = 5\n\n";
 
@@ -1345,9 +1510,44 @@ static void write_default_config()
 "# feeds_filename = feeds.xml\n\n";
 
 
+    // sqlite
+    conf += "# SQLite tuning, applied each time the database is opened. WAL lets rss vis and\n"
+"# other readers run while rss update writes. synchronous is off, normal, full or\n"
+"# extra; normal is safe with WAL. cache_size is pages, or KiB when negative.\n"
+"# mmap_size is bytes, 0 for none. temp_store is default, file or memory\n"
+"# db_journal_mode = wal\n"
+"# db_synchronous = normal\n"
+"# db_cache_size = -8192\n"
+"# db_mmap_size = 0\n"
+"# db_temp_store = default\n\n";
+
     file_put_contents( config_path.str, conf.str );
 }
 
+// check a db_* config value and hand it to DBA. allowed lists the words the
+//  pragma takes; without it the value has to be an integer
+static void config_pragma( const char * key, const char * pragma, basicString_t& val, const char ** allowed =0 )
+{
+    bool ok = false;
+    if ( allowed ) {
+        for ( int i = 0; allowed[i] && !ok; i++ )
+            ok = val.icompare( allowed[i] );
+    } else {
+        const char * p = val.str;
+        if ( p && *p == '-' )
+            ++p;
+        ok = p && *p;
+        for ( ; ok && *p; p++ )
+            ok = *p >= '0' && *p <= '9';
+    }
+
+    if ( !ok ) {
+        warning( "config: ignoring %s = %s\n", key, val.str );
+        return;
+    }
+    DBA.setPragma( pragma, val.str );
+}
+
 static void read_config()
 {
     // X db_path
@@ -1368,6 +1568,14 @@ static void read_config()
     // - empty_date_set_to_current_time
     // - update_title_len
     // X feed_timeouts_limit
+    // X fetch_parallel
+    // X fetch_per_host
+    // X parse_threads
+    // X db_journal_mode
+    // X db_synchronous
+    // X db_cache_size
+    // X db_mmap_size
+    // X db_temp_store
     // - disable_accelerated_menus
 
 
@@ -1435,6 +1643,39 @@ static void read_config()
                 if ( to_i != 0 ) // atoi returns 0 when arg isnt integer
                     feed_timeouts_limit = to_i;
             }
+            else if ( lhs == "fetch_parallel" ) {
+                int to_i = atoi(rhs.str);
+                if ( to_i > 0 )
+                    fetch_parallel = to_i;
+            }
+            else if ( lhs == "fetch_per_host" ) {
+                int to_i = atoi(rhs.str);
+                if ( to_i > 0 )
+                    fetch_per_host = to_i;
+            }
+            else if ( lhs == "parse_threads" ) {
+                int to_i = atoi(rhs.str);
+                if ( to_i > 0 )
+                    parse_threads = to_i;
+            }
+            else if ( lhs == "db_journal_mode" ) {
+                const char * modes[] = { "delete", "truncate", "persist", "memory", "wal", "off", 0 };
+                config_pragma( lhs.str, "journal_mode", rhs, modes );
+            }
+            else if ( lhs == "db_synchronous" ) {
+                const char * levels[] = { "off", "normal", "full", "extra", "0", "1", "2", "3", 0 };
+                config_pragma( lhs.str, "synchronous", rhs, levels );
+            }
+            else if ( lhs == "db_cache_size" ) {
+                config_pragma( lhs.str, "cache_size", rhs );
+            }
+            else if ( lhs == "db_mmap_size" ) {
+                config_pragma( lhs.str, "mmap_size", rhs );
+            }
+            else if ( lhs == "db_temp_store" ) {
+                const char * stores[] = { "default", "file", "memory", "0", "1", "2", 0 };
+                config_pragma( lhs.str, "temp_store", rhs, stores );
+            }
         }
 
         delete tokens;
@@ -1488,6 +1729,11 @@ static void setup_db_and_config()
         config_path.sprintf( "%s/config", config_dir.str );
 
 
+    // sqlite settings, unless the config says otherwise. WAL so readers
+    //  aren't locked out while update writes; normal sync is safe with it
+    DBA.setPragma( "journal_mode", "wal" );
+    DBA.setPragma( "synchronous", "normal" );
+
     //
     //  Config file setting
     //
@@ -1550,6 +1796,8 @@ static void setup_db_and_config()
         printf( "Database created successfully.\n" );
     }
 
+    upgrade_db();
+
     // look for html2text, disable and warn() if not found
     //  getenv("PATH")
     // if found, set fullpath as config_variable
@@ -1673,9 +1921,16 @@ static size_t _storeUrl( void *stringBuffer, size_t size, size_t nmemb, void * V
     return nmemb;
 }
 
+// write callback that takes nothing: by the time a body arrives the
+//  redirects are done, so the transfer can stop there
+static size_t _stopAtBody( void *, size_t, size_t, void * )
+{
+    return 0;
+}
+
 int get_url_with_curl( const char * url, basicString_t& returnData, bool follow = true )
 {
-    CURL * curl = curl_easy_init();
+    CURL * curl = fetch_context.getHandle();
     if ( !curl ) {
         warning( "failure in curl_easy_init()\n" );
         return 0;
@@ -1707,19 +1962,21 @@ int get_url_with_curl( const char * url, basicString_t& returnData, bool follow
     /* */
     curl_easy_setopt( curl, CURLOPT_TIMEOUT, curl_timeout_sec );
 
+    /* accept gzip, deflate, br; curl decodes as it streams into returnData */
+    curl_easy_setopt( curl, CURLOPT_ACCEPT_ENCODING, "" );
+
     /* Perform the request, res will get the return code */
     CURLcode res = curl_easy_perform( curl );
 
     /* Check for errors */
     if ( res != CURLE_OK ) {
         warning( "curl_easy_perform() failed: %s\n", curl_easy_strerror(res) );
-        curl_easy_cleanup( curl );
+        fetch_context.returnHandle( curl );
         return 0;
     }
 
-    /* always cleanup */
-    curl_easy_cleanup( curl );
-    curl_global_cleanup();
+    /* handle goes back to the context, keeping its connection open for next time */
+    fetch_context.returnHandle( curl );
 
     return 1;
 }
@@ -1755,26 +2012,45 @@ const char * get_last_forwarded_url( const char * uri )
     }
 
 
-    CURL * curl = curl_easy_init();
+    CURL * curl = fetch_context.getHandle();
     if ( !curl ) {
         warning( "failure in curl_easy_init()\n" );
         return 0;
     }
     curl_easy_setopt( curl, CURLOPT_URL, uri );
-    curl_easy_setopt( curl, CURLOPT_SSL_VERIFYPEER, false );
-    curl_easy_setopt( curl, CURLOPT_URL, uri );
-    curl_easy_setopt( curl, CURLOPT_HEADER, 0 );
-    curl_easy_setopt( curl, CURLOPT_AUTOREFERER, 1 );
-    curl_easy_setopt( curl, CURLOPT_FOLLOWLOCATION, 1 );
-    curl_easy_setopt( curl, CURLOPT_MAXREDIRS, 5 );
-    curl_easy_setopt( curl, CURLOPT_TIMEOUT, 30 );
+    curl_easy_setopt( curl, CURLOPT_SSL_VERIFYPEER, 0L );
+    curl_easy_setopt( curl, CURLOPT_HEADER, 0L );
+    curl_easy_setopt( curl, CURLOPT_AUTOREFERER, 1L );
+    curl_easy_setopt( curl, CURLOPT_FOLLOWLOCATION, 1L );
+    curl_easy_setopt( curl, CURLOPT_MAXREDIRS, 5L );
+    curl_easy_setopt( curl, CURLOPT_TIMEOUT, 30L );
+    curl_easy_setopt( curl, CURLOPT_USERAGENT, curl_user_agent.str );
+
+    /* only the final location is wanted, so ask for headers only */
+    curl_easy_setopt( curl, CURLOPT_NOBODY, 1L );
+    curl_easy_setopt( curl, CURLOPT_WRITEFUNCTION, _stopAtBody );
 
-    char * effective_url;
-    curl_easy_getinfo( curl, CURLINFO_EFFECTIVE_URL, &effective_url );
-    final = effective_url;
+    final = uri;
+    CURLcode code = curl_easy_perform( curl );
+    long http_code = 0;
+    curl_easy_getinfo( curl, CURLINFO_RESPONSE_CODE, &http_code );
+
+    /* some servers refuse HEAD; GET instead, hanging up once the body starts */
+    if ( code != CURLE_OK || http_code == 405 || http_code == 501 ) {
+        curl_easy_setopt( curl, CURLOPT_HTTPGET, 1L );
+        code = curl_easy_perform( curl );
+        if ( code == CURLE_WRITE_ERROR )
+            code = CURLE_OK;
+    }
+
+    if ( code == CURLE_OK ) {
+        char * effective_url = 0;
+        curl_easy_getinfo( curl, CURLINFO_EFFECTIVE_URL, &effective_url );
+        if ( effective_url )
+            final = effective_url;
+    }
 
-    curl_easy_cleanup( curl );
-    curl_global_cleanup();
+    fetch_context.returnHandle( curl );
 
     return final.str;
 }
@@ -1782,215 +2058,207 @@ const char * get_last_forwarded_url( const char * uri )
 
 
 //
-int have_item( Item_t& item )
+// which state of item the filter matches: count of hashes, highest id
+static void known_hashes_tags( long long& count, long long& high )
 {
-    /*
-     * item has 1-to-many feed relationship
-     *
-     * We check for items that that have: the same date (just the date part), AND same title
-     *
-     * if this item doesn't have date || title, we start checking: decription, media_url, item_url, content.
-     *  We must match against something, else the gesture would be futile. The goal is to match against 2 fields.
-     *
-     * if the item exists, but this particular item.feed_id is not noted in item_feeds.item_id = item_id,
-     *  an entry is added into item_feeds, return 1 (have item)
-     *
-     *
-     * HOW TO DETERMINE WHETHER ITEM MATCHES ANOTHER ITEM
-     *
-     *          feed_id date    title   item_url_media_url(both together must match)
-     *      S   -       M       M       M
-     *
-     *      N   d       x       M       M
-     *      S   M       x       M       M
-     *
-     *      N   d       M       x       M
-     *      S   M       M       x       M
-     *
-     *      N   d       M       M       x
-     *      S   M       M       M       x
-     *
-     *      N   -       M       d       d
-     *      N   -       d       M       d
-     *      N   -       d       d       M
-     *      N   -       d       d       d
-     *
-     * key: S=same, N=not same, -=feed_id doesnt matter, M=match, x,d=does not match
-     *
-     * there are 4 conditions where the item matches, and 12 where it does not, so it
-     *  follows to look only for matches, none being found we know we have a new item.
-     * The 4 matching coditions are:
-     *      S   x       M       M       M
-     *      S   M       x       M       M
-     *      S   M       M       x       M
-     *      S   M       M       M       x
-     *
-     * Therefor we do:
-     *  - determine what fields our item has. All items have feed_id; media_url+item_url are concatenated.
-     *  - does our item have at least 2 of the 3: (date,title,item_url+media_url)? If not, Item is unique.
-     *  - If our item has 3 of 3, we do: select id, substr(sqldate,0,11) as date,title,item_url,media_url from item where date='%s',title='%s',item_url='%s',media_url='%s'.  If numRows() > 0, we have a match, else unique
-     *  - else our item has 2 of 3, we must match the 2 we have & feed_Id. If those match => MATCH, else Unique
-     *
-     * to simplify this process, we'll do all the member determination in get_hash(), where in all the valid cases,
-     *  a hash will be generated by concatenating the appropriate fields together, or 0 when when one of the valid
-     *  cases are not met.  hash=0 items are always unique.  In order for an item to possess some form of discernable
-     *  identify, it must have 3 out of the 4 fields present. Otherwise an item does not possess sufficient enough
-     *  information to justify an hashable identity.  The order which we look is date+title+url first, failing one
-     *  of those, we do any 2 + feed_id.  So the hashes will always be uniform according to this flow-chart.
-     */
+    count = high = 0;
+    DBResult * res = DBA( "select count(hash) as c, max(id) as m from item;" );
+    if ( res && res->numRows() ) {
+        count = (*res)[0].getInt( "c" );
+        high = (*res)[0].getInt( "m" );
+    }
+}
+
+// from the sidecar file if it's current, else from the item table
+static void load_known_hashes()
+{
+    long long count, high;
+    known_hashes_tags( count, high );
+
+    basicString_t path( db_fullpath );
+    path += ".bloom";
+    if ( known_hashes.load( path.str, count, high ) && !known_hashes.full() ) {
+        known_hashes_count = count;
+        known_hashes_high = high;
+        return;
+    }
 
+    // streamed, and the tags are taken from the same walk, so they describe
+    //  exactly the rows read even if another rss is writing meanwhile
+    known_hashes.create( (unsigned long) count * 2 );
+    count = high = 0;
+    DBCursor * cur = DBA.cursor( "select hash, id from item;" );
+    while ( cur && cur->next() ) {
+        if ( !cur->isNull( 0 ) ) {
+            const char * hash = cur->getString( 0 );
+            if ( hash )
+                known_hashes.add( hash );
+            ++count;
+        }
+        if ( cur->getInt64( 1 ) > high )
+            high = cur->getInt64( 1 );
+    }
+    delete cur;
 
-    // safety first
-    DBA.fixQuotes( item.title );
-    DBA.fixQuotes( item.media_url );
-    DBA.fixQuotes( item.item_url );
+    known_hashes_count = count;
+    known_hashes_high = high;
+    known_hashes_changed = true;
+}
 
+void save_known_hashes()
+{
+    if ( !known_hashes_changed )
+        return;
+    known_hashes_changed = false;
 
-    basicString_t query;
-    basicString_t buf;
-    basicString_t url;
-    basicString_t& title = item.title;
-    basicString_t date = item.sqldate.substr(0,10);
+    long long count, high;
+    known_hashes_tags( count, high );
 
+    basicString_t path( db_fullpath );
+    path += ".bloom";
 
-    // need to construct custom string for url, since we are matching against all, one, the other, or none
-    //  depending on what the item has
-    if ( item.item_url.length() && item.media_url.length() )
-        url.sprintf( "and item_url = '%s' and media_url = '%s'", item.item_url.str, item.media_url.str );
-    else if ( item.item_url.length() )
-        url.sprintf( "and item_url = '%s'", item.item_url.str );
-    else if ( item.media_url.length() )
-        url.sprintf( "and media_url = '%s'", item.media_url.str );
+    // another rss added items while this one ran, or items were deleted;
+    //  the filter can't vouch for those. Next run rebuilds it
+    if ( count != known_hashes_count || high != known_hashes_high ) {
+        remove( path.str );
+        return;
+    }
 
+    if ( !known_hashes.save( path.str, count, high ) )
+        warning( "couldn't save %s\n", path.str );
+}
 
-    bool found = false;
-    DBResult * res = 0;
+void insert_item_feed( int item_id, int feed_id )
+{
+    DBStatement * st = DBA.prepare( "insert_item_feed", "insert into item_feeds(item_id,feed_id) values (?1,?2);" );
+    if ( st )
+        st->bind( 1, item_id ).bind( 2, feed_id ).exec();
+}
 
-    // the 4 matching conditions
-    if ( title.length() && date.length() && url.length() )
-    {
-        query = buf.sprintf( "select feed_id,item_id, substr(sqldate,0,11) as date from item_feeds,item where item_feeds.item_id=item.id and (date='%s' and title='%s' %s);", date.str, title.str, url.str );
-        res = DBA( query.str );
-        found = res != 0 && res->numRows() > 0;
-    }
+int have_item( Item_t& item )
+{
+    /*
+     * item has 1-to-many feed relationship
+     *
+     * An item's identity is its hash; see Item_t::get_hash(). When it has a date, title
+     *  and url (item_url and/or media_url), those are hashed, so the same post carried by
+     *  several feeds is one item. When it has only 2 of the 3, the feed_id is hashed with
+     *  them, so it only matches within its own feed. With fewer, there is no hash and the
+     *  item is always unique.
+     *
+     * if the item exists, but this particular item.feed_id is not noted in item_feeds.item_id = item_id,
+     *  an entry is added into item_feeds, return 1 (have item)
+     *
+     * both lookups are on an index: item(hash) and item_feeds(item_id,feed_id)
+     */
 
-    if ( !found && title.length() && date.length() )
-    {
-        query = buf.sprintf( "select feed_id,item_id, substr(sqldate,0,11) as date from item_feeds,item where item_feeds.item_id=item.id and (feed_id=%d and date='%s' and title='%s');", item.feed_id, date.str, title.str );
-        res = DBA( query.str );
-        found = res != 0 && res->numRows() > 0;
-    }
 
-    if ( !found && title.length() && url.length() )
-    {
-        query = buf.sprintf( "select feed_id,item_id, substr(sqldate,0,11) as date from item_feeds,item where item_feeds.item_id=item.id and (feed_id=%d and title='%s' %s);", item.feed_id, title.str, url.str );
-        res = DBA( query.str );
-        found = res != 0 && res->numRows() > 0;
-    }
+    if ( item.hash.length() == 0 )
+        return 0; // no identity, unique
 
-    if ( !found && date.length() && url.length() )
-    {
-        query = buf.sprintf( "select feed_id,item_id, substr(sqldate,0,11) as date from item_feeds,item where item_feeds.item_id=item.id and (feed_id=%d and date='%s' %s);", item.feed_id, date.str, url.str );
-        res = DBA( query.str );
-        found = res != 0 && res->numRows() > 0;
-    }
+    if ( !known_hashes.ready() )
+        load_known_hashes();
+    if ( !known_hashes.maybeHas( item.hash.str ) )
+        return 0; // never seen it; no need to ask
 
+    DBStatement * st = DBA.prepare( "item_by_hash", "select id from item where hash = ?1 limit 1;" );
+    if ( !st )
+        return 0;
+    st->bind( 1, item.hash );
+    int item_id = st->step() == SQLITE_ROW ? st->getInt( 0 ) : 0;
+    st->reset();
 
-    if ( !found ) {
+    if ( 0 == item_id ) {
+        known_hashes.falsePositive();
         return 0; // item definitely doesn't exist
     }
 
     // see if item already placed here by this feed_id
-    DBRow * row;
-    while ( (row = res->NextRow()) )
-    {
-        DBValue * v = row->FindByName( "feed_id" );
-        if ( v && v->getInt() == item.feed_id )
-        {
-            return 1; // item already a member of this feed; we have it.
-        }
-    }
-
-    // note: only gets here for the first type: title,date,url all match, but feed_id is different
-    //       so we have the item already, but must add the entry in the connector table so this feed also gets it
-
-    // item exists but is not yet member of this feed, add it
-    res->resetRowCount();
-
-    // get item_id
-    DBValue * v = res->FindByNameFirstRow("item_id");
-    int item_id = v ? v->getInt() : 0;
-
-    if ( 0 == item_id ) {
-        warning( "problem finding item_id. this should never happen.\n" );
+    st = DBA.prepare( "item_feed_member", "select id from item_feeds where item_id = ?1 and feed_id = ?2 limit 1;" );
+    if ( !st )
         return 0;
-    }
+    st->bind( 1, item_id ).bind( 2, item.feed_id );
+    int member = st->step() == SQLITE_ROW;
+    st->reset();
+    if ( member )
+        return 1; // item already a member of this feed; we have it.
 
-    DBA( buf.sprintf( "insert into item_feeds (item_id,feed_id) values (%d,%d);", item_id, item.feed_id ).str );
+    // item exists but is not yet member of this feed, add it
+    insert_item_feed( item_id, item.feed_id );
 
     return 1; // wasn't a member of this feed, but we connected it and say we have it
 }
 
-int insert_item( Item_t& item )
+// empty fields are stored as NULL, same as leaving them out of the insert
+static inline void bind_field( DBStatement * st, int index, const basicString_t& s )
 {
-    // title, media_url, item_url escaped in have_item(). Don't do twice!
-    DBA.fixQuotes( item.description );
-    DBA.fixQuotes( item.pubDate );
-    DBA.fixQuotes( item.content );
-    DBA.fixQuotes( item.author );
+    if ( s.length() )
+        st->bind( index, s );
+    else
+        st->bindNull( index );
+}
 
-    basicString_t query( "insert into item(" );
-    basicString_t values( ") values (" );
-    basicString_t buf;
+// add to the search index, with the same values item got
+static void index_item( int item_id, Item_t& item )
+{
+    if ( !have_search_index )
+        return;
 
+    DBStatement * st = DBA.prepare( "index_item", "insert into item_fts(rowid,title,description,content,author) values (?1,?2,?3,?4,?5);" );
+    if ( !st )
+        return;
 
-    // construct query dynamically, to avoid sprintf'ing null strings, which show up as the string: "(null)"
-    if ( item.title.length() ) {
-        query += "title,";
-        values += buf.sprintf( "'%s',", item.title.str );
-    }
-    if ( item.description.length() ) {
-        query += "description,";
-        values += buf.sprintf( "'%s',", item.description.str );
-    }
-    if ( item.pubDate.length() ) {
-        query += "pubDate,";
-        values += buf.sprintf( "'%s',", item.pubDate.str );
-    }
-    if ( item.sqldate.length() ) {
-        query += "sqldate,";
-        values += buf.sprintf( "'%s',", item.sqldate.str );
-    }
-    if ( item.media_url.length() ) {
-        query += "media_url,";
-        values += buf.sprintf( "'%s',", item.media_url.str );
-    }
-    if ( item.item_url.length() ) {
-        query += "item_url,";
-        values += buf.sprintf( "'%s',", item.item_url.str );
-    }
-    if ( item.content.length() ) {
-        query += "content,";
-        values += buf.sprintf( "'%s',", item.content.str );
-    }
-    if ( item.author.length() ) {
-        query += "author,";
-        values += buf.sprintf( "'%s',", item.author.str );
-    }
-    if ( item.hash.length() ) {
-        query += "hash,";
-        values += buf.sprintf( "'%s',", item.hash.str );
-    }
+    st->bind( 1, item_id );
+    bind_field( st, 2, item.title );
+    bind_field( st, 3, item.description );
+    bind_field( st, 4, item.content );
+    bind_field( st, 5, item.author );
+    st->exec();
+}
 
-    // tag is always N
-    query += "tag";
-    query += values += "'N');";
+// the item row and its search index entry. The index has to be told what
+//  it had for the item, so it goes first
+void delete_item( int item_id )
+{
+    basicString_t query;
+    if ( have_search_index )
+        DBA( query.sprintf( "insert into item_fts(item_fts,rowid,title,description,content,author) select 'delete',id,title,description,content,author from item where id = %d;", item_id ).str );
+    DBA( query.sprintf( "delete from item where id = %d;", item_id ).str );
 
+    // a loaded filter still says yes to its hash, which is harmless, but its tags no longer line up
+    if ( known_hashes.ready() )
+        known_hashes_high = -1;
+}
 
-    DBResult * insertRes = DBA( query.str );
-    if ( insertRes ) {
-        int item_id = insertRes->lastInsertId();
-        DBA( query.sprintf( "insert into item_feeds(item_id,feed_id) values (%d, %d);", item_id, item.feed_id ).str );
+int insert_item( Item_t& item )
+{
+    DBStatement * st = DBA.prepare( "insert_item", "insert into item(title,description,pubDate,sqldate,media_url,item_url,content,author,hash,tag) values (?1,?2,?3,?4,?5,?6,?7,?8,?9,'N');" );
+    if ( !st )
+        return 0;
+
+    bind_field( st, 1, item.title );
+    bind_field( st, 2, item.description );
+    bind_field( st, 3, item.pubDate );
+    bind_field( st, 4, item.sqldate );
+    bind_field( st, 5, item.media_url );
+    bind_field( st, 6, item.item_url );
+    bind_field( st, 7, item.content );
+    bind_field( st, 8, item.author );
+    bind_field( st, 9, item.hash );
+
+    if ( st->exec() ) {
+        int item_id = st->lastInsertId();
+        insert_item_feed( item_id, item.feed_id );
+        index_item( item_id, item );
+        if ( known_hashes.ready() ) {
+            if ( item.hash.length() ) {
+                known_hashes.add( item.hash.str );
+                ++known_hashes_count;
+            }
+            if ( known_hashes_high >= 0 && item_id > known_hashes_high )
+                known_hashes_high = item_id;
+            known_hashes_changed = true;
+        }
         return item_id;
     }
 
@@ -2016,8 +2284,12 @@ int highest_item_id()
     return 1;
 }
 
-int finish_conditional_item_insert( Item_t& item, int * high_item_id, basicString_t * saved_ids )
+// everything short of the database; safe to run off the main thread
+void prepare_item( Item_t& item )
 {
+    if ( item.pubDate.length() )
+        item.sqldate = get_sqldate( item.pubDate );
+
     // easier to set items w/o date to current time
     if ( empty_date_set_to_current_time && item.sqldate.length() == 0 ) {
         item.sqldate = sqldate_now();
@@ -2028,7 +2300,11 @@ int finish_conditional_item_insert( Item_t& item, int * high_item_id, basicStrin
 
     // gen hash before escaping quotes
     item.gen_hash();
+}
 
+// item must have been through prepare_item()
+int finish_conditional_item_insert( Item_t& item, int * high_item_id, basicString_t * saved_ids )
+{
     // add
     if ( !have_item( item ) )
     {
@@ -2053,314 +2329,46 @@ int finish_conditional_item_insert( Item_t& item, int * high_item_id, basicStrin
 }
 
 
-int insert_items_atom( const XMLElement * elt, int feed_id, basicString_t * saved_ids, int high_item_id )
+// a feed's items, collected as the parser hands them over
+struct parsedFeed_t
 {
-    Item_t item;
-    int num_inserted = 0;
-    int transaction_started = 0;
+    feedParser_t parser;
+    buffer_t<Item_t*> items;
+    bool prepared;              // prepare_items() has run
 
+    parsedFeed_t();
+    ~parsedFeed_t() {
+        for ( unsigned int i = 0; i < items.length(); i++ )
+            delete items[i];
+    }
+};
 
-    /*
-        title       --> <title>
-        description --> <summary>
-        pubDate     --> <published> | <updated>
-        media_url   -->
-        item_url    --> <link type="text/html" href= | <id>
-        content     --> <content>
-        author      --> <author><name>
-    */
-    basicString_t ENTRY("entry");
-    basicString_t TITLE("title");
-    basicString_t SUMMARY("summary");
-    basicString_t PUBLISHED("published");
-    basicString_t UPDATED("updated");
-    basicString_t LINK("link");
-    basicString_t TEXT_HTML( "text/html" );
-    basicString_t CONTENT( "content" );
-    basicString_t AUTHOR( "author" );
-    basicString_t NAME( "name" );
-    basicString_t ID( "id" );
-    basicString_t ALTERNATE( "alternate" );
-
-    // foreach item (in reverse so that newer posts are higher row id))
-    for ( const XMLElement * field = elt->LastChildElement( "entry" ); field; field=field->PreviousSiblingElement() )
-    {
-        if ( ! ENTRY.icompare(field->Value()) )
-            continue;
+// feedItem_f
+static void collect_item( Item_t * item, void * arg )
+{
+    parsedFeed_t * parsed = static_cast<parsedFeed_t *>( arg );
+    parsed->items.add( new Item_t( std::move( *item ) ) ); // the parser clears it for the next one anyway
+}
 
-        // found at least one item to insert; begin transaction
-        if ( !transaction_started ) {
-            DBA.BeginTransaction();
-            transaction_started = 1;
-        }
-
-        item.clear();
-        item.feed_id = feed_id;
-
-        // foreach child of entry element
-        for ( const XMLElement * sub = field->FirstChildElement(); sub; sub = sub->NextSiblingElement() )
-        {
-            const char * eltName = sub->Value();
-            if ( !eltName )
-                continue;
-
-            if ( TITLE.icompare(eltName) )
-            {
-                const XMLNode * text = sub->FirstChild();
-                if ( text )
-                    item.title = text->Value();
-            }
-            else if ( SUMMARY.icompare(eltName) )
-            {
-                const XMLNode * text = sub->FirstChild();
-                if ( text )
-                    item.description = text->Value();
-            }
-            else if ( PUBLISHED.icompare(eltName) )
-            {
-                // higher priority than UPDATED, so will overwrite if we have it
-                const XMLNode * text = sub->FirstChild();
-                if ( text ) {
-                    item.pubDate = text->Value();
-                    item.sqldate = get_sqldate( item.pubDate );
-                }
-            }
-            else if ( UPDATED.icompare(eltName) )
-            {
-                if ( ! item.pubDate.length() ) {
-                    const XMLNode * text = sub->FirstChild();
-                    if ( text ) {
-                        item.pubDate = text->Value();
-                        item.sqldate = get_sqldate( item.pubDate );
-                    }
-                }
-            }
-            else if ( LINK.icompare(eltName) )
-            {
-                // link has higher priority than id, so will overwrite it if found
-                const XMLAttribute * attr = sub->FindAttribute( "type" );
-                if ( attr && TEXT_HTML.icompare(attr->Value()) ) {
-                    attr = sub->FindAttribute( "href" );
-                    if ( attr )
-                        item.item_url = attr->Value();
-                }
-                else { // reason.com:-> <link rel="alternate" href="..." >
-                    const XMLAttribute * attr = sub->FindAttribute("alternate");
-                    if ( attr && ALTERNATE.icompare(attr->Value()) ) {
-                        attr = sub->FindAttribute( "href" );
-                        if ( attr )
-                            item.item_url = attr->Value();
-                    }
-                }
-            }
-            else if ( ID.icompare(eltName) ) {
-                if ( !item.item_url.length() ) {
-                    const XMLNode * text = sub->FirstChild();
-                    if ( text )
-                        item.item_url = text->Value();
-                }
-            }
-            else if ( CONTENT.icompare(eltName) )
-            {
-                const XMLNode * text = sub->FirstChild();
-                if ( text )
-                    item.content = text->Value();
-            }
-            else if ( AUTHOR.icompare(eltName) )
-            {
-                const XMLElement * elt = sub->FirstChildElement("name");
-                if ( elt ) {
-                    const XMLNode * text = elt->FirstChild();
-                    if ( text )
-                        item.author = text->Value();
-                }
-            }
-        }
+parsedFeed_t::parsedFeed_t() : parser( collect_item, this ), items(), prepared(false)
+{ }
 
-        // done scanning item elements
-        if ( finish_conditional_item_insert( item, &high_item_id, saved_ids ) )
-            ++num_inserted;
+// dates and hashes for every item; no database, so the parse pool can do it
+static void prepare_items( parsedFeed_t& parsed, int feed_id )
+{
+    for ( unsigned int i = 0; i < parsed.items.length(); i++ ) {
+        parsed.items[i]->feed_id = feed_id;
+        prepare_item( *parsed.items[i] );
     }
-
-    if ( transaction_started )
-        DBA.Commit();
-
-    return num_inserted;
+    parsed.prepared = true;
 }
 
-int insert_items_rss( const XMLElement * elt, int feed_id, basicString_t * saved_ids, int high_item_id )
+// parse a whole document that is already in memory
+static void parse_feed_string( parsedFeed_t& parsed, const basicString_t& buf )
 {
-    Item_t item;
-    int num_inserted = 0;
-    int transaction_started = 0;
-
-    // both rdf & rss have a channel
-    const XMLElement * channel = elt->FirstChildElement( "channel" );
-    if ( !channel ) {
-        channel = elt->FirstChildElement( "rss:channel" );
-        if ( !channel ) {
-            warning ( "rss feed type not rss 2.0 or rdf\n" );
-            return 0;
-        }
-    }
-
-    basicString_t ITEM( "item" );
-    basicString_t RSS_ITEM( "rss:item" );
-
-    const char * item_name = "item";
-
-    // see if RDF
-    // FIXME: some known-good rss feeds are failing here
-    if ( ! channel->FirstChildElement( "item" ) )
-    {
-        channel = elt; // channel set to parent
-
-        elt = channel->FirstChildElement( "item" );
-        if ( !elt ) {
-            elt = channel->FirstChildElement( "rss:item" );
-            if ( elt )
-                item_name = "rss:item";
-        }
-        if ( !elt || (!ITEM.icompare(elt->Value()) && !RSS_ITEM.icompare(elt->Value())) ) {
-            warning ( "feed has no items\n" );
-            return 0;
-        }
-    }
-
-
-    basicString_t TITLE( "title" );
-    basicString_t RSS_TITLE( "rss:title" );
-    basicString_t DESCRIPTION( "description" );
-    basicString_t ITUNES_SUMMARY( "itunes:summary" );
-    basicString_t ITUNES_SUBTITLE( "itunes:subtitle" );
-    basicString_t PUBDATE( "pubdate" );
-    basicString_t DC_DATE( "dc:date" );
-    basicString_t ENCLOSURE( "enclosure" );
-    basicString_t MEDIA_CONTENT( "media:content" );
-    basicString_t LINK( "link" );
-    basicString_t RSS_LINK( "rss:link" );
-    basicString_t GUID( "guid" );
-    basicString_t ATOM_LINK( "atom:link" );
-    basicString_t CONTENT_ENCODED( "content:encoded" );
-    basicString_t AUTHOR( "author" );
-    basicString_t DC_CREATOR( "dc:creator" );
-    basicString_t ITUNES_AUTHOR( "itunes:author" );
-
-
-    // foreach item (in reverse so that older posts are lower row id))
-    for ( const XMLElement * field = channel->LastChildElement( item_name ); field; field=field->PreviousSiblingElement() )
-    {
-        if ( !ITEM.icompare( field->Value() ) && !RSS_ITEM.icompare( field->Value() ) )
-            continue;
-
-        // found at least one item to insert; begin transaction
-        if ( !transaction_started ) {
-            DBA.BeginTransaction();
-            transaction_started = 1;
-        }
-
-        item.clear();
-        item.feed_id = feed_id;
-
-        /*
-            title       --> <title>
-            description --> <description> | <itunes:summary> | <itunes:subtitle>
-            pubDate     --> <pubDate> | <dc:date>
-            media_url   --> <enclosure url= | <media:content url=
-            item_url    --> <link> | <guid> | <atom:link href=
-            content     --> <content:encoded>
-            author      --> <author> | <dc:creator> | <itunes:author>
-        */
-
-        // foreach child of item element
-        for ( const XMLElement * sub = field->FirstChildElement(); sub; sub = sub->NextSiblingElement() )
-        {
-            const char * eltName = sub->Value();
-            if ( !eltName )
-                continue;
-
-            if ( TITLE.icompare(eltName) || RSS_TITLE.icompare(eltName) )
-            {
-                const XMLNode * text = sub->FirstChild();
-                if ( text )
-                    item.title = text->Value();
-            }
-            else if ( DESCRIPTION.icompare(eltName) )
-            {
-                // no constraint: will override other description; higher priority
-                const XMLNode * text = sub->FirstChild();
-                if ( text )
-                    item.description = text->Value();
-            }
-            else if ( ITUNES_SUMMARY.icompare(eltName) || ITUNES_SUBTITLE.icompare(eltName) )
-            {
-                if ( ! item.description.length() ) {
-                    const XMLNode * text = sub->FirstChild();
-                    if ( text )
-                        item.description = text->Value();
-                }
-            }
-            else if ( PUBDATE.icompare(eltName) )
-            {
-                // higher priority than DC_DATE
-                const XMLNode * text = sub->FirstChild();
-                if ( text ) {
-                    item.pubDate = text->Value();
-                    item.sqldate = get_sqldate( item.pubDate );
-                }
-            }
-            else if ( DC_DATE.icompare(eltName) )
-            {
-                if ( !item.pubDate.length() ) {
-                    const XMLNode * text = sub->FirstChild();
-                    if ( text ) {
-                        item.pubDate = text->Value();
-                        item.sqldate = get_sqldate( item.pubDate );
-                    }
-                }
-            }
-            else if ( ENCLOSURE.icompare(eltName) || MEDIA_CONTENT.icompare(eltName) )
-            {
-                if ( !item.media_url.length() ) {
-                    const XMLAttribute * attr = sub->FindAttribute( "url" );
-                    if ( attr )
-                        item.media_url = attr->Value();
-                }
-            }
-            else if ( LINK.icompare(eltName) || ATOM_LINK.icompare(eltName) || GUID.icompare(eltName) || RSS_LINK.icompare(eltName) )
-            {
-                if ( !item.item_url.length() ) {
-                    const XMLNode * text = sub->FirstChild();
-                    if ( text )
-                        item.item_url = text->Value();
-                }
-            }
-            else if ( CONTENT_ENCODED.stristr(eltName) )
-            {
-                const XMLNode * text = sub->FirstChild();
-                if ( text )
-                    item.content = text->Value();
-            }
-            else if ( AUTHOR.icompare(eltName) || DC_CREATOR.icompare(eltName) || ITUNES_AUTHOR.icompare(eltName) )
-            {
-                if ( !item.author.length() ) {
-                    const XMLNode * text = sub->FirstChild();
-                    if ( text )
-                        item.author = text->Value();
-                }
-            }
-        }
-
-        // done scanning item elements
-        if ( finish_conditional_item_insert( item, &high_item_id, saved_ids ) )
-            ++num_inserted;
-    }
-
-    if ( transaction_started )
-        DBA.Commit();
-
-    return num_inserted;
-} // insert_items_rss
+    parsed.parser.feed( buf.str, buf.length() );
+    parsed.parser.finish();
+}
 
 
 // returns 0 if item hits timeout limit, # of timeouts otherwise
@@ -2383,11 +2391,10 @@ int check_timeouts( int feed_id )
 
 void reset_timeouts( int feed_id )
 {
-    basicString_t buf;
-    DBResult * res = DBA( buf.sprintf( "select id from feed where id = %d and timeouts = 0 and (errmsg is null or errmsg = '');", feed_id ).str );
-    if ( res && res->numRows() == 1 )
-        return;
-    DBA( buf.sprintf( "update feed set timeouts = 0, errmsg = '' where id = %d;", feed_id ).str );
+    // only writes when there is something to clear
+    DBStatement * st = DBA.prepare( "reset_timeouts", "update feed set timeouts = 0, errmsg = '' where id = ?1 and (ifnull(timeouts,0) != 0 or ifnull(errmsg,'') != '');" );
+    if ( st )
+        st->bind( 1, feed_id ).exec();
 }
 
 int update_timeouts_disable_if_needed( int feed_id )
@@ -2415,33 +2422,147 @@ int update_timeouts_disable_if_needed( int feed_id )
 
 
 
+/*
+==============================================================================
+
+    feed polling schedule
+
+    Each feed gets a next_due time. The interval is learned from the gaps
+    between its recent posts, and never undercuts what the feed asks for
+    (<ttl>, Cache-Control, Expires). <skipHours> are stepped over. Failed
+    fetches back off exponentially. 'rss update --due' only fetches feeds
+    whose time has come.
+
+==============================================================================
+*/
+#define POLL_MIN_SEC            (15*60)
+#define POLL_MAX_SEC            (24*60*60)
+#define POLL_DEFAULT_SEC        (60*60)
+#define POLL_HISTORY            10
+
+// half the average gap between recent posts, stretched if the feed has since gone quiet
+static int learn_poll_interval( int feed_id )
+{
+    basicString_t buf;
+    DBResult * res = DBA( buf.sprintf( "select strftime('%%s',item.sqldate) as t from item_feeds, item where item_feeds.item_id = item.id and item_feeds.feed_id = %d and item.sqldate like '____-__-__ __:__:__' order by item.sqldate desc limit %d;", feed_id, POLL_HISTORY ).str );
+    if ( !res || res->numRows() < 2 )
+        return POLL_DEFAULT_SEC;
+
+    long long newest = atoll( (*res)[0][0].getString() ? (*res)[0][0].getString() : "0" );
+    long long oldest = atoll( (*res)[res->numRows()-1][0].getString() ? (*res)[res->numRows()-1][0].getString() : "0" );
+    long long interval = (newest - oldest) / (long long)(res->numRows() - 1) / 2;
+
+    // sqldates are local time, so compare against local now
+    res = DBA( buf.sprintf( "select strftime('%%s','now','localtime') - strftime('%%s',last_updated) as quiet from feed where id = %d;", feed_id ).str );
+    DBValue * v = res ? res->FindByNameFirstRow( "quiet" ) : 0;
+    if ( v && v->getString() ) {
+        long long quiet = atoll( v->getString() );
+        if ( quiet / 2 > interval )
+            interval = quiet / 2;
+    }
+
+    if ( interval < POLL_MIN_SEC )
+        interval = POLL_MIN_SEC;
+    if ( interval > POLL_MAX_SEC )
+        interval = POLL_MAX_SEC;
+    return (int) interval;
+}
+
+// sets next_due after a fetch. parser is 0 when there was nothing parsed (error or 304)
+static void schedule_next_fetch( int feed_id, const fetchJob_t * job, const feedParser_t * parser )
+{
+    basicString_t buf;
+    DBResult * res = DBA( buf.sprintf( "select failures, poll_interval, skip_hours from feed where id = %d;", feed_id ).str );
+    DBValue * v;
+    int failures = res && (v = res->FindByNameFirstRow( "failures" )) ? v->getInt() : 0;
+    int interval = res && (v = res->FindByNameFirstRow( "poll_interval" )) ? v->getInt() : 0;
+    unsigned int skip = res && (v = res->FindByNameFirstRow( "skip_hours" )) ? (unsigned) v->getInt() : 0;
+
+    int wait;
+    if ( job->code != CURLE_OK || job->http_code >= 400 )
+    {
+        // back off: 15m, 30m, 1h ... up to a day
+        int n = failures++;
+        wait = n >= 7 ? POLL_MAX_SEC : POLL_MIN_SEC << n;
+    }
+    else
+    {
+        failures = 0;
+        if ( parser ) {
+            interval = learn_poll_interval( feed_id );
+            int ttl = parser->ttl * 60;
+            if ( ttl > interval )
+                interval = ttl < POLL_MAX_SEC ? ttl : POLL_MAX_SEC;
+            skip = parser->skip_hours;
+            if ( skip == 0xFFFFFF )
+                skip = 0; // skipping every hour would never be due
+        }
+        else if ( interval <= 0 ) {
+            interval = learn_poll_interval( feed_id );
+        }
+
+        wait = interval;
+        if ( job->max_age > wait )
+            wait = job->max_age < POLL_MAX_SEC ? job->max_age : POLL_MAX_SEC;
+    }
+
+    time_t due = time(0) + wait;
+
+    // step past skipped hours
+    for ( int i = 0; skip && i < 24; i++ ) {
+        struct tm g;
+        gmtime_r( &due, &g );
+        if ( !(skip & (1u << g.tm_hour)) )
+            break;
+        due += 3600 - (due % 3600);
+    }
+
+    DBA( buf.sprintf( "update feed set next_due = %lld, poll_interval = %d, skip_hours = %u, failures = %d where id = %d;", (long long) due, interval, skip, failures, feed_id ).str );
+}
+
+
 // returns num new items inserted for this feed
-int insert_any_new_items( const XMLDocument& document, int feed_id, int * status =0, basicString_t * saved_ids =0 )
+int insert_any_new_items( parsedFeed_t& parsed, int feed_id, int * status =0, basicString_t * saved_ids =0 )
 {
     // get max items.id
     int high_item_id = highest_item_id();
+    int num_inserted = 0;
 
     if ( status )
         *status = 1; // ok so far
 
-    const XMLElement * elt = document.FirstChildElement( "rss" );
-    if ( elt )
-        return insert_items_rss( elt, feed_id, saved_ids, high_item_id );
+    if ( parsed.parser.type() == FEED_UNKNOWN )
+    {
+        if ( status )
+            *status = 0; // not rss, atom or rdf; signal bad feed error
 
-    elt = document.FirstChildElement( "feed" );
-    if ( elt )
-        return insert_items_atom( elt, feed_id, saved_ids, high_item_id );
+        update_timeouts_disable_if_needed( feed_id );
+        return 0; // 0 items fetched
+    }
 
-    elt = document.FirstChildElement( "rdf:RDF" );
-    if ( elt )
-        return insert_items_rss( elt, feed_id, saved_ids, high_item_id );
+    if ( 0 == parsed.items.length() ) {
+        if ( parsed.parser.type() != FEED_ATOM )
+            warning ( "feed has no items\n" );
+        return 0;
+    }
 
+    if ( !parsed.prepared )
+        prepare_items( parsed, feed_id );
 
-    if ( status )
-        *status = 0; // fell through to here, signal bad feed error
+    DBA.BeginTransaction();
+
+    // foreach item (in reverse so that older posts are lower row id)
+    for ( int i = (int) parsed.items.length() - 1; i >= 0; i-- )
+    {
+        Item_t& item = *parsed.items[i];
+
+        if ( finish_conditional_item_insert( item, &high_item_id, saved_ids ) )
+            ++num_inserted;
+    }
+
+    DBA.Commit();
 
-    update_timeouts_disable_if_needed( feed_id );
-    return 0; // 0 items fetched
+    return num_inserted;
 }
 
 int insert_feed_no_matter_what( Feed_t& feed )
@@ -2511,6 +2632,15 @@ const char * __getIfExists( const char * s, DBRow * R )
     return buf;
 }
 
+// by column index, from DBCursor::colIndex()
+const char * __getIfExists( int col, DBCursor * C )
+{
+    static char buf[2] = { ' ', 0 };
+    if ( col < 0 )
+        return buf;
+    return C->getString( col );
+}
+
 const char * __DontGetIfNotExist( const char * s, DBRow * R )
 {
     DBValue * v = R->FindByName( s );
@@ -2876,53 +3006,30 @@ static void start_pager()
     }
 }
 
-basicString_t& gen_rss_feed( DBResult * itemRes, const char * title =0, const char * link =0, const char * description =0, const char *generator =0 )
+// writes an rss document for the items to out, as it walks them. With a
+//  printer on a FILE nothing is held but the current row
+void gen_rss_feed( XMLPrinter& out, DBCursor * items, const char * title =0, const char * link =0, const char * description =0, const char *generator =0 )
 {
-    // this is what we put it in
-    static basicString_t out;
-    out.erase();
-
-    // tiny xml doc handle
-    XMLDocument doc;
-
     /* xml version="1.0" encoding="UTF-8" */
-    doc.InsertEndChild( doc.NewDeclaration() );
+    out.PushDeclaration( "xml version=\"1.0\" encoding=\"UTF-8\"" );
 
     /* rss version="2.0" */
-    XMLElement * rss = doc.NewElement( "rss" );
-    doc.InsertEndChild( rss );
-    rss->SetAttribute( "version", "2.0" );
+    out.OpenElement( "rss" );
+    out.PushAttribute( "version", "2.0" );
 
     /* channel */
-    XMLElement * channel = doc.NewElement( "channel" );
-    rss->InsertEndChild( channel );
+    out.OpenElement( "channel" );
 
-    if ( title ) {
-        XMLElement * node = doc.NewElement( "title" );
-        XMLText * text = doc.NewText( title ) ;
-        node->InsertEndChild( text );
-        channel->InsertEndChild( node );
-    }
+    const char * chan_attr[] = { "title", "link", "description", "generator" };
+    const char * chan_val[] = { title, link, description, generator };
 
-    if ( link ) {
-        XMLElement * node = doc.NewElement( "link" );
-        XMLText * text = doc.NewText( link ) ;
-        node->InsertEndChild( text );
-        channel->InsertEndChild( node );
-    }
-
-    if ( description ) {
-        XMLElement * node = doc.NewElement( "description" );
-        XMLText * text = doc.NewText( description ) ;
-        node->InsertEndChild( text );
-        channel->InsertEndChild( node );
-    }
-
-    if ( generator ) {
-        XMLElement * node = doc.NewElement( "generator" );
-        XMLText * text = doc.NewText( generator ) ;
-        node->InsertEndChild( text );
-        channel->InsertEndChild( node );
+    for ( int i = 0; i < 4; i++ )
+    {
+        if ( chan_val[i] ) {
+            out.OpenElement( chan_attr[i] );
+            out.PushText( chan_val[i] );
+            out.CloseElement();
+        }
     }
 
     // TODO: <lastBuildDate>Fri, 26 Apr 2013 21:33:37 -0400</lastBuildDate>
@@ -2930,78 +3037,60 @@ basicString_t& gen_rss_feed( DBResult * itemRes, const char * title =0, const ch
     // <dc:date>2013-04-25T07:00:00+00:00</dc:date>
 
     // doing it this way cuz I'm too lazy to write the tons of code needed to format the other method
-    const char * dc_date = make_dcdate( sqldate_now() );
-    XMLElement * node = doc.NewElement( "dc:date" );
-    XMLText * text = doc.NewText( dc_date ) ;
-    node->InsertEndChild( text );
-    channel->InsertEndChild( node );
+    out.OpenElement( "dc:date" );
+    out.PushText( make_dcdate( sqldate_now() ) );
+    out.CloseElement();
 
 
     // attach all the items
 #define ITEM_STRING_SZ 8
 
-    struct sixpack {
-        basicString_t val[ITEM_STRING_SZ];
-        basicString_t& operator[] ( unsigned int i ) {
-            return val[i];
-        }
-        void clear() {
-            for ( unsigned int i = 0 ; i < ITEM_STRING_SZ; i++ ) { val[i].erase(); }
-        }
-    } six;
-
     const char * attr[] = { "title", "description", "pubDate", "guid",
                         "link", "content:encoded", "dc:creator", "dc:date" };
 
-    DBRow * row;
-    while ( (row = itemRes->NextRow()) )
+    const char * cols[] = { "title", "description", "pubDate", "media_url",
+                        "item_url", "content", "author", "sqldate" };
+
+    int col[ ITEM_STRING_SZ ];
+    for ( int i = 0 ; i < ITEM_STRING_SZ ; i++ )
+        col[i] = items ? items->colIndex( cols[i] ) : -1;
+
+    // point into the cursor's row; nothing is copied
+    const char * six[ ITEM_STRING_SZ ];
+
+    while ( items && items->next() )
     {
-        six.clear();
-        six[0] = __DontGetIfNotExist( "title", row );
-        six[1] = __DontGetIfNotExist( "description", row );
-        six[2] = __DontGetIfNotExist( "pubDate", row );
-        six[3] = __DontGetIfNotExist( "media_url", row );
-        six[4] = __DontGetIfNotExist( "item_url", row );
-        six[5] = __DontGetIfNotExist( "content", row );
-        six[6] = __DontGetIfNotExist( "author", row );
-        six[7] = __DontGetIfNotExist( "sqldate", row );
+        for ( int i = 0 ; i < ITEM_STRING_SZ ; i++ )
+            six[i] = items->getString( col[i] );
 
         // item
-        XMLElement * item = doc.NewElement( "item" );
-        channel->InsertEndChild( item );
+        out.OpenElement( "item" );
 
         for ( int i = 0 ; i < ITEM_STRING_SZ ; i++ )
         {
-            if ( six[i].length() )
-            {
-                // only get dc:date if we dont have pubDate
-                if ( 7 == i ) {
-                    if ( six[2].length() )
-                        continue;
-                    six[i] = make_dcdate( six[i].str );
-                }
-
-                XMLElement * node = doc.NewElement( attr[i] );
-                XMLText * text = doc.NewText( six[i].str ) ;
-                node->InsertEndChild( text );
+            if ( !six[i] )
+                continue;
 
-                if ( 5 == i ) {
-                    text->SetCData(true); // content:encoded is always <![CDATA[
-                }
+            const char * text = six[i];
 
-                // attach element to item node
-                item->InsertEndChild( node );
+            // only get dc:date if we dont have pubDate
+            if ( 7 == i ) {
+                if ( six[2] )
+                    continue;
+                text = make_dcdate( text );
             }
+
+            out.OpenElement( attr[i] );
+            out.PushText( text, 5 == i ); // content:encoded is always <![CDATA[
+            out.CloseElement();
         }
+
+        out.CloseElement(); // item
     }
 #undef ITEM_STRING_SZ
 
-    // get string from tinyxml
-    XMLPrinter printer;
-    doc.Print( &printer );
-    out = printer.CStr(); // const char* to the XML
-
-    return out;
+    out.CloseElement(); // channel
+    out.CloseElement(); // rss
 }
 
 int rss_deleteBookmark( int saved_id )
@@ -3036,14 +3125,24 @@ int rss_deleteItem( int item_id )
 // bookmarks stuff
 //
 
-void bookmark_rss_string_from_db( basicString_t **rss_pp )
+static void bookmark_rss_from_db( XMLPrinter& out )
 {
-    DBResult * res = DBA( "select distinct feed.title as ftitle, item_feeds.feed_id, item.* from feed,item_feeds,item,saved_links where item_feeds.item_id = item.id and item_feeds.feed_id = feed.id and saved_links.item_id = item.id  order by saved_links.timestamp desc;" );
+    DBCursor * cur = DBA.cursor( "select distinct feed.title as ftitle, item_feeds.feed_id, item.* from feed,item_feeds,item,saved_links where item_feeds.item_id = item.id and item_feeds.feed_id = feed.id and saved_links.item_id = item.id  order by saved_links.timestamp desc;" );
 
     basicString_t title;
     title.sprintf( "RSS Power Tool Bookmarks for %s", username.str );
 
-    basicString_t& string = gen_rss_feed( res, title.str, 0, 0, RSS_GENERATOR );
+    gen_rss_feed( out, cur, title.str, 0, 0, RSS_GENERATOR );
+    delete cur;
+}
+
+void bookmark_rss_string_from_db( basicString_t **rss_pp )
+{
+    static basicString_t string;
+
+    XMLPrinter printer;
+    bookmark_rss_from_db( printer );
+    string = printer.CStr();
     *rss_pp = &string;
 }
 
@@ -3074,7 +3173,6 @@ int bookmark_xml_to_db( const XMLDocument& document )
 
     basicString_t ITEM( "item" );
     bool transaction_started = false;
-    basicString_t buf;
     basicString_t query;
     basicString_t timestamp_base;
     timestamp_base.strncpy( sqldate_now(), 10 );
@@ -3155,9 +3253,9 @@ int bookmark_xml_to_db( const XMLDocument& document )
         // have to query to get the ids. might not have them
         query.sprintf( "select feed_id,item_id from item_feeds,item where item_feeds.item_id = item.id and item.title = '%s'", title.str );
         if ( pubDate.length() )
-            query += buf.sprintf( " and item.pubDate = '%s';", pubDate.str );
+            query.appendf( " and item.pubDate = '%s';", pubDate.str );
         else
-            query += buf.sprintf( " and item.sqldate = '%s';", dc_date.str );
+            query.appendf( " and item.sqldate = '%s';", dc_date.str );
 
         DBResult * res = DBA( query.str );
         if ( !res )
@@ -3297,6 +3395,7 @@ void rss_add()
 */
     basicString_t fetch;
     XMLDocument document;
+    parsedFeed_t parsed;
     Feed_t * feed = 0;
     int feed_id = 0;
     bool insert_new = false;
@@ -3311,8 +3410,9 @@ void rss_add()
             return rss_add_usage( "unable to fetch url.");
         }
 
-        // generate XML document to get items
+        // generate XML document for the feed, and parse out its items
         document.Parse( fetch.str, fetch.length() );
+        parse_feed_string( parsed, fetch );
         feed = feed_from_document( document );
         // overwrite xmlUrl, since we supplied it
         feed->xmlUrl = cmd_args[0]->str;
@@ -3326,8 +3426,10 @@ void rss_add()
             return rss_add_usage( "argument not a file." );
         }
 
-        // generate XML document to get items, from path
-        document.LoadFile( path );
+        // generate XML document for the feed, and parse out its items, from path
+        file_get_contents( path, fetch );
+        document.Parse( fetch.str, fetch.length() );
+        parse_feed_string( parsed, fetch );
         feed = feed_from_document( document );
         insert_new = true;
     }
@@ -3340,7 +3442,9 @@ void rss_add()
         if ( !path || *cmd_args[0] != "-f" || 0 == feed_id ) {
             return rss_add_usage( "argument not a file." );
         }
-        document.LoadFile( path );
+        file_get_contents( path, fetch );
+        document.Parse( fetch.str, fetch.length() );
+        parse_feed_string( parsed, fetch );
         feed = feed_from_document( document );
     }
     else {
@@ -3372,8 +3476,8 @@ void rss_add()
     }
 
 
-    // takes XMLDocument and inserts items
-    int total_inserted = insert_any_new_items( document, feed_id );
+    // inserts the parsed items
+    int total_inserted = insert_any_new_items( parsed, feed_id );
 
     // report how many items
     printf( "%d items pulled for %s\n", total_inserted, unescaped_title.str );
@@ -3419,9 +3523,8 @@ void rss_dump()
     if ( cmd_args.count() == 1 )
     {
         if ( *cmd_args[0] == "-b" ) {
-            basicString_t * bs;
-            bookmark_rss_string_from_db( &bs );
-            fwrite( bs->str, 1, bs->length(), stdout );
+            XMLPrinter printer( stdout );
+            bookmark_rss_from_db( printer );
             return;
         }
         match = cmd_args[0];
@@ -3493,12 +3596,12 @@ void rss_dump()
     }
     buf += ";";
 
-    DBResult * itemRes = DBA( buf.str );
-
-
-    basicString_t& feedBuf = gen_rss_feed( itemRes, feed.title.str, feed.htmlUrl.str, feed.description.str, RSS_GENERATOR );
+    // streamed straight out, a row at a time
+    DBCursor * items = DBA.cursor( buf.str );
 
-    fwrite( feedBuf.str, 1, feedBuf.length(), stdout );
+    XMLPrinter printer( stdout );
+    gen_rss_feed( printer, items, feed.title.str, feed.htmlUrl.str, feed.description.str, RSS_GENERATOR );
+    delete items;
 
 } // rss_dump
 
@@ -3511,10 +3614,12 @@ const char * last_report_ids()
     return v ? v->getString() : 0;
 }
 
-void print_feed_items( DBResult * res, bool newest_first =true, bool display_body =true, bool isHtml =false )
+// walks the cursor from the row it is on, printing as it goes. With the
+//  total, items are numbered down from it, so the oldest is 1; else up from 1
+void print_feed_items( DBCursor * res, unsigned int total, bool display_body =true, bool isHtml =false )
 {
     if ( !res )
-        return ;
+        return;
 
     //
     basicString_t stripped;
@@ -3527,29 +3632,37 @@ void print_feed_items( DBResult * res, bool newest_first =true, bool display_bod
     //
     // PRINT FEED ITEM
     //
-    unsigned int row_num = 1;
-    DBRow * row;
-    while ( (row = res->NextRow()) )
+    // look the columns up once
+    int c_tag = res->colIndex( "tag" );
+    int c_title = res->colIndex( "title" );
+    int c_desc = res->colIndex( "description" );
+    int c_date = res->colIndex( "sqldate" );
+    int c_media = res->colIndex( "media_url" );
+    int c_item = res->colIndex( "item_url" );
+    int c_ftitle = res->colIndex( "ftitle" );
+    int c_feed = res->colIndex( "feed_id" );
+    int c_content = res->colIndex( "content" );
+    int c_author = res->colIndex( "author" );
+
+    do
     {
         //TAG (N,D,S,X,V), TITLE, trunc(DESCRIPTION,x), DATE, MEDIA
-        basicString_t tag = __getIfExists( "tag", row );
-        basicString_t title = __getIfExists( "title", row );
-        basicString_t desc = __getIfExists( "description", row );
-        //desc.strncpy( __getIfExists("description",row), rss_show_description_len );
-        ///basicString_t date = __getIfExists( "sqldate", row );
+        basicString_t tag = __getIfExists( c_tag, res );
+        basicString_t title = __getIfExists( c_title, res );
+        basicString_t desc = __getIfExists( c_desc, res );
         basicString_t date;
-        date.strncpy( __getIfExists( "sqldate", row ), 16 );
-        basicString_t media_url = __getIfExists( "media_url", row );
-        basicString_t item_url = __getIfExists( "item_url", row );
+        date.strncpy( __getIfExists( c_date, res ), 16 );
+        basicString_t media_url = __getIfExists( c_media, res );
+        basicString_t item_url = __getIfExists( c_item, res );
 
-        unsigned int item_id = newest_first ? res->numRows() - row_num + 1 : row_num;
+        unsigned int item_id = total ? total - res->rowNum() + 1 : (unsigned int) res->rowNum();
 
         basicString_t ftitle;
-        ftitle.strncpy( __getIfExists( "ftitle", row ), rss_show_ftitle_len );
+        ftitle.strncpy( __getIfExists( c_ftitle, res ), rss_show_ftitle_len );
 
-        basicString_t feed_id = __getIfExists( "feed_id", row );
-        basicString_t content = __getIfExists( "content", row );
-        basicString_t author = __getIfExists( "author", row );
+        basicString_t feed_id = __getIfExists( c_feed, res );
+        basicString_t content = __getIfExists( c_content, res );
+        basicString_t author = __getIfExists( c_author, res );
 
         if ( isHtml ) {
             printf( "\n<div class=\"item\">\n<h3>" );
@@ -3628,8 +3741,8 @@ void print_feed_items( DBResult * res, bool newest_first =true, bool display_bod
         }
 
         fflush( stdout );
-        ++row_num;
     }
+    while ( res->next() );
 
     if ( isHtml ) {
         printf( "%s", htmlFooter );
@@ -3880,14 +3993,17 @@ void rss_show()
     //
 
     //
-    query = "select feed.title as ftitle, item_feeds.feed_id, item.* from feed,item,item_feeds where item_feeds.feed_id=feed.id and item_feeds.item_id=item.id";
+    basicString_t from( " from feed,item,item_feeds where item_feeds.feed_id=feed.id and item_feeds.item_id=item.id" );
 
     // constraints
     if ( sql_where.length() )
     {
-        query.append( buf.sprintf( " and (%s)", sql_where.str ) );
+        from.append( buf.sprintf( " and (%s)", sql_where.str ) );
     }
 
+    query = "select feed.title as ftitle, item_feeds.feed_id, item.*";
+    query.append( from );
+
     bool newest_first = true;
 
     // items from last update also sort by priority
@@ -3917,17 +4033,30 @@ void rss_show()
     //
     // actually do query
     //
-    DBResult * res = DBA( query.str );
+    DBCursor * res = DBA.cursor( query.str );
 
-    if ( !res || res->numRows() == 0 ) {
+    if ( !res || !res->next() ) {
+        delete res;
         printf( "No items returned.\n" );
         return;
     }
 
+    // newest first counts down to 1, which needs the total up front. Counting
+    //  is cheap next to fetching every row
+    unsigned int total = 0;
+    if ( newest_first ) {
+        DBResult * c = DBA( query.sprintf( "select count(*) as c%s;", from.str ).str );
+        DBValue * v = c ? c->FindByNameFirstRow( "c" ) : 0;
+        total = v ? (unsigned int) v->getInt() : 0;
+        if ( (qcode&CODE_SHOW_LIMIT)==CODE_SHOW_LIMIT && limit >= 0 && total > (unsigned int) limit )
+            total = limit;
+    }
+
     //
     // output results to the screen
     //
-    print_feed_items( res, newest_first, (qcode&CODE_SHOW_NO_BODY)!=CODE_SHOW_NO_BODY, isHtml );
+    print_feed_items( res, total, (qcode&CODE_SHOW_NO_BODY)!=CODE_SHOW_NO_BODY, isHtml );
+    delete res;
 
 } // rss_show
 
@@ -4057,12 +4186,19 @@ void rss_list()
     sprintf( titlefmt, "%%-%d.%ds", rss_list_title_maxlen+2, rss_list_title_maxlen );
 
 
+    int c_id = res->colIndex( "id" );
+    int c_title = res->colIndex( "title" );
+    int c_updated = res->colIndex( "last_updated" );
+    int c_disabled = res->colIndex( "disabled" );
+    int c_type = res->colIndex( "type" );
+    int c_errmsg = res->colIndex( "errmsg" );
+
     // fuck
     for ( unsigned int j = 0; j < res->numRows(); j++ )
     {
         DBRow& row = (*res)[j];
 
-        DBValue * v = row.FindByName( "id" );
+        DBValue * v = row.column( c_id );
         int id = v->getInt();
 
         DBResult * cRes = DBA( buf.sprintf("select count(item.id) as count from item_feeds, item where item_feeds.item_id = item.id and item_feeds.feed_id = %d;",id).str );
@@ -4074,7 +4210,7 @@ void rss_list()
         printf( id_fmt, v->getInt() );
 
 
-        v = row.FindByName( "title" );
+        v = row.column( c_title );
         const char * str = v->getString();
         int len = str ? strlen( str ) : 0;
         int utf8len = utf8strlen( str );
@@ -4090,7 +4226,7 @@ void rss_list()
         }
 
         buf.erase();
-        v = row.FindByName( "last_updated" );
+        v = row.column( c_updated );
         if ( v && v->getString() && strlen(v->getString()) > 0 ) {
             buf.strncpy( v->getString(), 10 );
             if ( buf.length() > 0 )
@@ -4101,16 +4237,16 @@ void rss_list()
             printf( "%-4d  %-10s", count_v ? count_v->getInt() : -1, "no dates" );
         }
 
-        v = row.FindByName( "disabled" );
+        v = row.column( c_disabled );
         if ( v && v->getInt() == 1 )
             printf( "  DISABLED " );
         else
             printf( "           " );
 
-        v = row.FindByName( "type" );
+        v = row.column( c_type );
         printf( " %6.6s", v && v->getString() ? v->getString() : "" );
 
-        v = row.FindByName( "errmsg" );
+        v = row.column( c_errmsg );
         printf( " %s", v && v->getString() && strlen(v->getString())>0 ? v->getString() : "" );
 
         printf( "\n" );
@@ -4285,38 +4421,394 @@ void remove_reports_over_quota()
     }
 }
 
+// running totals for an update, shared by each feed as its fetch completes
+struct updateState_t
+{
+    int feeds_altered;
+    int total_inserted;
+    long long bytes_wire;
+    long long bytes_decoded;
+    stringbuffer_t updated_feeds;
+    basicString_t ids_inserted;
+    char url_fmt[ 16 ];
+
+    updateState_t() : feeds_altered(0), total_inserted(0), bytes_wire(0), bytes_decoded(0), updated_feeds(), ids_inserted()
+    {
+        url_fmt[0] = '\0';
+    }
+};
+
+// job->user is the feed's DBRow, parsed holds its items, ready to insert
+static void update_feed( fetchJob_t * job, updateState_t& state, parsedFeed_t& parsed )
+{
+    DBRow& row = *static_cast<DBRow *>( job->user );
+    DBValue * val;
+
+    basicString_t description;
+    basicString_t last_updated;
+    basicString_t query;
+
+    // title, id from feeds-row
+    val = row.FindByName( "title" );
+    const char * title = !val ? "none" : val->getString() ? val->getString() : "none";
+    int feed_id = job->id;
+
+    printf( state.url_fmt, feed_id, title ); // TITLE
+    fflush(stdout);
+
+    if ( job->code != CURLE_OK )
+    {
+        warning( "curl_easy_perform() failed: %s\n", curl_easy_strerror(job->code) );
+
+        int to = 0;
+        if ( job->decoded_bytes == 0 ) {
+            to = update_timeouts_disable_if_needed( feed_id );
+        }
+        printf("\n");
+
+        // put in report so we can see record of what's timing out
+        basicString_t * str_p = new basicString_t;
+        if ( to )
+            str_p->sprintf( " X- [%d] %s timed out %s time!11\n", feed_id, title, to > 9 ? "nth" : ordinals[to] );
+        else
+            str_p->sprintf( " X- [%d] %s timed out!11\n", feed_id, title );
+        state.updated_feeds.push_back( str_p );
+        schedule_next_fetch( feed_id, job, 0 );
+        return;
+    }
+
+    // unchanged since last time; nothing to parse
+    if ( job->notModified() ) {
+        reset_timeouts( feed_id );
+        schedule_next_fetch( feed_id, job, 0 );
+        printf( "\n" );
+        fflush(stdout);
+        return;
+    }
+
+    // remember validators for the next conditional GET
+    if ( 200 == job->http_code && (!job->resp_etag.compare( job->etag ) || !job->resp_last_modified.compare( job->last_modified )) )
+    {
+        basicString_t etag( job->resp_etag );
+        basicString_t modified( job->resp_last_modified );
+        DBA.fixQuotes( etag );
+        DBA.fixQuotes( modified );
+        DBA( query.sprintf( "update feed set etag = '%s', last_modified = '%s' where id = %d;", etag.length() ? etag.str : "", modified.length() ? modified.str : "", feed_id ).str );
+    }
+
+    // what compression saved us
+    state.bytes_wire += job->wire_bytes;
+    state.bytes_decoded += job->decoded_bytes;
+    DBA( query.sprintf( "update feed set bytes_wire = %lld, bytes_decoded = %lld where id = %d;", job->wire_bytes, job->decoded_bytes, feed_id ).str );
+
+
+    int inserted_this_feed = 0;
+
+    // this is used to signify that a feed is either 1=OK, or 0=in Error
+    int feed_status = 0;
+
+
+    //
+    // INSERT ITEMS
+    //
+    inserted_this_feed = insert_any_new_items( parsed, feed_id, &feed_status, &state.ids_inserted );
+
+    // feed_status 1 is OK
+    if ( 1 == feed_status ) {
+        // fetch successful, reset timeouts if needed
+        reset_timeouts( feed_id );
+    }
+
+
+    // get description & pubDate from feed if we have it
+    val = row.FindByName( "description" );
+
+    // if feed doesn't already have a description (opml doesn't usually carry one)
+    if ( !val || !val->getString() || strlen(val->getString())== 0 || strcmp(val->getString(),"(null)") == 0 )
+    {
+        // the parser kept the channel's description, subtitle, itunes:summary or itunes:subtitle
+        description = parsed.parser.description();
+        DBA.fixQuotes( description );
+    }
+
+    // update counters and save a summary, if we got any
+    if ( inserted_this_feed )
+    {
+        ++state.feeds_altered;
+        basicString_t * str_p = new basicString_t;
+        str_p->sprintf( "  * [%d] %s, %d item%c\n", feed_id, title, inserted_this_feed, inserted_this_feed>1?'s':' ' );
+        state.updated_feeds.push_back( str_p );
+        state.total_inserted += inserted_this_feed;
+    }
+
+
+    // get newest sqldate from items
+    DBResult * result = DBA( query.sprintf( "select feed.last_updated,item.sqldate from item_feeds,feed,item where item_feeds.feed_id = feed.id and item_feeds.item_id = item.id and feed.id = %d order by item.sqldate desc limit 1;", feed_id ).str );
+    if ( result ) {
+        val = result->FindByNameFirstRow( "sqldate" );
+        if ( val )
+            last_updated = val->getString();
+        val = result->FindByNameFirstRow( "last_updated" );
+        if ( val && last_updated == val->getString() )
+            last_updated = 0; // only bother to update if dates differ
+    }
+
+    // report how many items directly, as your getting them
+    if ( inserted_this_feed > 0 )
+        printf( "  %d new item%s\n", inserted_this_feed, inserted_this_feed>1?"s":"" );
+    else
+        printf( "\n" );
+    fflush(stdout);
+
+
+    // set last_update to time of most recent post, and fix description if we dont have it and scraped one from the feed
+    if ( (inserted_this_feed > 0 || feed_status == 1) && (description.length() > 0 || last_updated.length() > 0) )
+    {
+        basicString_t fmt;
+        query = "update feed set ";
+        if ( description.length() > 0 ) {
+            query.append( "description = '" );
+            query.append( description );
+        }
+        if ( last_updated.length() > 0 ) {
+            if ( description.length() > 0 )
+                query.append("',");
+            query.append( "last_updated = '" );
+            query.append( last_updated );
+        }
+        DBA( query.append( fmt.sprintf( "' where id = %d;", feed_id ) ).str );
+    }
+
+    // after last_updated is current, since it feeds the interval
+    schedule_next_fetch( feed_id, job, &parsed.parser );
+}
+
+/********************************************************
+ *
+ *  update pipeline
+ *
+ *  - fetch thread: runs the fetch engine. As pieces of a body arrive they
+ *    are queued on that feed's work, in order, and the work is handed to
+ *    the parse pool if it isn't there already. Nothing else happens there
+ *  - parse pool: a worker claims a feed, parses whatever has arrived for
+ *    it so far, and lets it go until more comes. Once the transfer is
+ *    done and all of it parsed, the items are dated and hashed
+ *  - writer: the main thread. Only it touches DBA and stdout
+ *
+ *  Stages are connected by bounded queues; a null pointer means the
+ *  stage before has nothing more to send. The fetch thread never waits on
+ *  a full queue while transfers are running: what doesn't fit is held
+ *  back and handed on between rounds of the engine, and no new transfer
+ *  is started until it has all gone.
+ */
+struct updateWork_t
+{
+    fetchJob_t *    job;
+    parsedFeed_t    parsed;
+
+    // guards the three below; the fetch thread adds, the parse pool takes
+    pthread_mutex_t lock;
+    basicString_t   arrived;    // body not yet parsed
+    bool            fetched;    // transfer is over, nothing more will arrive
+    bool            queued;     // in toParse, held back, or claimed by a parser
+
+    updateWork_t( fetchJob_t * j ) : job(j), parsed(), arrived(), fetched(false), queued(false)
+    { pthread_mutex_init( &lock, 0 ); }
+
+    ~updateWork_t() { pthread_mutex_destroy( &lock ); }
+};
+
+struct updatePipeline_t
+{
+    fetchEngine_t *                 engine;
+    boundedQueue_t<updateWork_t*>   toParse;
+    boundedQueue_t<updateWork_t*>   toWrite;
+    unsigned int                    parsers;
+    int                             parsersLeft;
+
+    // toParse was full; fetch thread only
+    buffer_t<updateWork_t*>         overflow;
+    unsigned int                    overflowNext;
+
+    updatePipeline_t( fetchEngine_t * e, unsigned int nparse ) : engine(e), toParse(64), toWrite(64), parsers(nparse), parsersLeft((int)nparse), overflow(), overflowNext(0)
+    { }
+};
+
+// hand on what was held back, in order, as far as toParse has room.
+//  fetchIdle_f; returns nonzero if some is still waiting
+static int update_drain_overflow( void * arg )
+{
+    updatePipeline_t& pipe = *static_cast<updatePipeline_t *>( arg );
+
+    while ( pipe.overflowNext < pipe.overflow.length() && pipe.toParse.push( pipe.overflow[ pipe.overflowNext ] ) )
+        ++pipe.overflowNext;
+
+    if ( pipe.overflowNext < pipe.overflow.length() )
+        return 1;
+    pipe.overflow.reset();
+    pipe.overflowNext = 0;
+    return 0;
+}
+
+// fetchHold_f; no new transfers while the parse pool is behind
+static int update_overflowing( void * arg )
+{
+    updatePipeline_t& pipe = *static_cast<updatePipeline_t *>( arg );
+    return pipe.overflowNext < pipe.overflow.length();
+}
+
+// to the parse pool, without waiting
+static void update_post( updatePipeline_t& pipe, updateWork_t * work )
+{
+    // keep the order: nothing jumps ahead of what is held back
+    if ( update_drain_overflow( &pipe ) || !pipe.toParse.push( work ) )
+        pipe.overflow.add( work );
+}
+
+// the work for a job, made on first use
+static updateWork_t * update_work( fetchJob_t * job )
+{
+    if ( !job->stream )
+        job->stream = new updateWork_t( job );
+    return static_cast<updateWork_t *>( job->stream );
+}
+
+// fetchWrite_f; on the fetch thread, as each piece of a body arrives
+static void update_feed_chunk( fetchJob_t * job, const char * buf, unsigned int len, void * arg )
+{
+    updateWork_t * work = update_work( job );
+
+    pthread_mutex_lock( &work->lock );
+    work->arrived.append( buf, len );
+    bool post = !work->queued;
+    work->queued = true;
+    pthread_mutex_unlock( &work->lock );
+
+    if ( post )
+        update_post( *static_cast<updatePipeline_t *>( arg ), work );
+}
+
+// fetchDone_f; on the fetch thread, so it must not wait
+static void update_feed_fetched( fetchJob_t * job, void * arg )
+{
+    // errors and 304s may have had no body, so no work yet
+    updateWork_t * work = update_work( job );
+    job->stream = 0;
+
+    pthread_mutex_lock( &work->lock );
+    work->fetched = true;
+    bool post = !work->queued;
+    work->queued = true;
+    pthread_mutex_unlock( &work->lock );
+
+    if ( post )
+        update_post( *static_cast<updatePipeline_t *>( arg ), work );
+}
+
+static void * update_fetch_thread( void * arg )
+{
+    updatePipeline_t& pipe = *static_cast<updatePipeline_t *>( arg );
+
+    pipe.engine->setIdleHook( update_drain_overflow, &pipe );
+    pipe.engine->setHoldHook( update_overflowing, &pipe );
+    pipe.engine->run( update_feed_fetched, &pipe );
+
+    // transfers are done; waiting is fine now
+    for ( ; pipe.overflowNext < pipe.overflow.length(); pipe.overflowNext++ )
+        pipe.toParse.pushWait( pipe.overflow[ pipe.overflowNext ] );
+
+    for ( unsigned int i = 0; i < pipe.parsers; i++ )
+        pipe.toParse.pushWait( 0 );
+    return 0;
+}
+
+static void * update_parse_thread( void * arg )
+{
+    updatePipeline_t& pipe = *static_cast<updatePipeline_t *>( arg );
+    updateWork_t * work;
+    basicString_t chunk;
+
+    while ( (work = pipe.toParse.popWait()) )
+    {
+        // this thread has it until it lets go, so its pieces go in in order
+        bool done;
+        for ( ;; ) {
+            pthread_mutex_lock( &work->lock );
+            std::swap( chunk, work->arrived );
+            done = work->fetched && !chunk.length();
+            if ( !chunk.length() && !done )
+                work->queued = false;   // the next piece posts it again
+            pthread_mutex_unlock( &work->lock );
+
+            if ( !chunk.length() )
+                break;
+            work->parsed.parser.feed( chunk.str, chunk.length() );
+            chunk.erase();
+        }
+
+        if ( !done )
+            continue;
+
+        fetchJob_t * job = work->job;
+        if ( job->code == CURLE_OK && !job->notModified() ) {
+            work->parsed.parser.finish();
+            prepare_items( work->parsed, job->id );
+        }
+        pipe.toWrite.pushWait( work );
+    }
+
+    // last one out tells the writer
+    if ( 0 == __atomic_sub_fetch( &pipe.parsersLeft, 1, __ATOMIC_ACQ_REL ) )
+        pipe.toWrite.pushWait( 0 );
+    return 0;
+}
+
 void rss_update()
 {
     if ( check_cmdline( "-h" ) || check_cmdline( "--help" ) ) {
-        printf( "usage: %s update [matching parms]\n\n", exename.str );
+        printf( "usage: %s update [--due] [matching parms]\n\n", exename.str );
         printf( "    where matching parms could be numeric or string\n    eg. 'rss update 10-15,16,20' or 'rss update hacker'\n    The latter would get all feeds with the word hacker in their title.\n    The former would get feeds with id 10 through 15, 16 and 20\n    With no arguments it updates all feeds.\n" );
+        printf( "    --due only fetches feeds whose next scheduled check has come. Each feed's\n    schedule is learned from how often it posts.\n" );
         return;
     }
 
     basicString_t fetch( "select * from feed where (disabled = 0)" );
-    basicString_t description;
-    basicString_t last_updated;
     basicString_t matches;
+    bool due_only = false;
 
     // group cmd_args together
-    for ( unsigned int i = 0 ; i < cmd_args.count(); i++ )
+    for ( unsigned int i = 0 ; i < cmd_args.count(); i++ ) {
+        if ( *cmd_args[i] == "--due" ) {
+            due_only = true;
+            continue;
+        }
         matches += *cmd_args[i] + " ";
+    }
 
     matches.trim();
 
     // this figures it out
     matches = translate_unknown_args( matches.str );
 
+    if ( due_only ) {
+        basicString_t due;
+        fetch.append( due.sprintf( " and (next_due is null or next_due <= %lld)", (long long) time(0) ) );
+    }
+
     if ( matches.length() )
-        fetch.sprintf( "select * from feed where (disabled = 0) and %s;", matches.str );
-    else
-        fetch.append(";");
+        fetch.append( " and " ).append( matches );
+    fetch.append(";");
 
 
     DBResult * res = DBA( fetch.str );
 
     if ( !res || res->numRows() == 0 )
     {
+        if ( due_only ) {
+            printf( "no feeds are due for an update.\n" );
+            return;
+        }
+
         res = DBA( "select count(id) as c from feed;" );
         DBValue * v = res ? res->FindByNameFirstRow("c") : 0;
         if ( !v || v->getInt() == 0 )
@@ -4326,10 +4818,7 @@ void rss_update()
         return;
     }
 
-    int feeds_altered = 0;
-    int total_inserted = 0;
-    stringbuffer_t updated_feeds;
-    basicString_t ids_inserted;
+    updateState_t state;
 
     if ( res->numRows() > 0 )
         printf( "Updating your feeds:\n" );
@@ -4338,195 +4827,92 @@ void rss_update()
     timer.set();
 
     unsigned int degree = ((unsigned int) log10( highest_feed_id() )) + 1;
-    char url_fmt[ 16 ];
 
     // FIXME: a) if update_title_len = 0, then title length is not constrained;
     //        b) utf8len needed here with dynamic format to ensure justified columns
-    sprintf( url_fmt, "%%-%dd %%-%u.%us", degree, update_title_len, update_title_len );
+    sprintf( state.url_fmt, "%%-%dd %%-%u.%us", degree, update_title_len, update_title_len );
 
-    // foreach feed
-    for ( unsigned int i = 0; i < res->numRows(); i++ )
-    {
-        DBRow& row = (*res)[i];
-        DBValue * val;
-
-        // title, id from feeds-row
-        val = row.FindByName( "title" );
-        const char * title = !val ? "none" : val->getString() ? val->getString() : "none";
-        val = row.FindByName( "id" );
-        int feed_id = val ? val->getInt() : 0;
-
-        // erase buffer before every fetch
-        fetch.erase();
-
-        // get the xmlurl
-        if ( (val = row.FindByName( "xmlUrl" )) ) {
-            //printf( url_fmt, feed_id, val->getString() ); // URL
-            printf( url_fmt, feed_id, title ); // TITLE
-            fflush(stdout);
+    // queue every feed, then fetch them all at once. Each is parsed as it
+    //  downloads and inserted as soon as it is done, while the others keep going.
+    fetchEngine_t engine( fetch_parallel, fetch_per_host, &fetch_context );
+    engine.setTimeout( curl_timeout_sec );
+    engine.setUserAgent( curl_user_agent.str );
 
-            //
-            // FETCH FEED
-            //
-            if ( !get_url_with_curl( val->getString(), fetch ) ) {
-                int to = 0;
-                if ( fetch.length() == 0 ) {
-                    to = update_timeouts_disable_if_needed( feed_id );
-                }
-                printf("\n");
-
-                // put in report so we can see record of what's timing out
-                basicString_t * str_p = new basicString_t;
-                if ( to )
-                    str_p->sprintf( " X- [%d] %s timed out %s time!11\n", feed_id, title, to > 9 ? "nth" : ordinals[to] );
-                else
-                    str_p->sprintf( " X- [%d] %s timed out!11\n", feed_id, title );
-                updated_feeds.push_back( str_p );
-
-
-                continue;
-            }
-        }
-
-
-        // generate XML document from the html-fetch to get items
-        XMLDocument document;
-        document.Parse( fetch.str, fetch.length() );
-
-
-        description = 0;
-        last_updated = 0;
-        int inserted_this_feed = 0;
-
-        // this is used to signify that a feed is either 1=OK, or 0=in Error
-        int feed_status = 0;
-
-
-        //
-        // INSERT ITEMS
-        //
-        inserted_this_feed = insert_any_new_items( document, feed_id, &feed_status, &ids_inserted );
-
-        // feed_status 1 is OK
-        if ( 1 == feed_status ) {
-            // fetch successful, reset timeouts if needed
-            reset_timeouts( feed_id );
-        }
-
-
-        // get description & pubDate from feed if we have it
-        val = row.FindByName( "description" );
-
-        // if feed doesn't already have a description (opml doesn't usually carry one)
-        if ( !val || !val->getString() || strlen(val->getString())== 0 || strcmp(val->getString(),"(null)") == 0 )
-        {
-            // try rss
-            XMLElement * elt = document.FirstChildElement( "rss" );
-            if ( elt )
-                elt = elt->FirstChildElement( "channel" );
-            // try atom
-            if ( !elt )
-                elt = document.FirstChildElement( "feed" );
-            // try rdf
-            if ( !elt ) {
-                elt = document.FirstChildElement( "rdf:RDF" );
-                if ( elt )
-                    elt = elt->FirstChildElement( "channel" );
-            }
-
-            if ( elt )
-            {
-                // possible kinds of description, ordered in terms of desirability
-                const char * tries[] = { "description", "subtitle", "itunes:summary", "itunes:subtitle", 0 };
-                const char **T = tries;
-                do
-                {
-                    XMLElement * field = elt->FirstChildElement( *T );
-                    if ( field ) {
-                        XMLNode * goal = field->FirstChild();
-                        if ( goal ) {
-                            description = goal->Value();
-                            DBA.fixQuotes( description );
-                            break; // found; take first one
-                        }
-                    }
-                }
-                while ( *++T );
-            }
-        }
+    unsigned int nparse = parse_threads;
+    if ( 0 == nparse ) {
+        long cpus = sysconf( _SC_NPROCESSORS_ONLN );
+        nparse = cpus < 1 ? 1 : cpus > 8 ? 8 : (unsigned int) cpus;
+    }
 
-        // update counters and save a summary, if we got any
-        if ( inserted_this_feed )
-        {
-            ++feeds_altered;
-            basicString_t * str_p = new basicString_t;
-            str_p->sprintf( "  * [%d] %s, %d item%c\n", feed_id, title, inserted_this_feed, inserted_this_feed>1?'s':' ' );
-            updated_feeds.push_back( str_p );
-            total_inserted += inserted_this_feed;
-        }
+    updatePipeline_t pipe( &engine, nparse );
+    engine.setWriteHook( update_feed_chunk, &pipe );
 
+    for ( unsigned int i = 0; i < res->numRows(); i++ )
+    {
+        DBRow& row = (*res)[i];
+        DBValue * val = row.FindByName( "xmlUrl" );
+        DBValue * id = row.FindByName( "id" );
+        if ( !val || !val->getString() )
+            continue;
 
-        // get newest sqldate from items
-        DBResult * result = DBA( fetch.sprintf( "select feed.last_updated,item.sqldate from item_feeds,feed,item where item_feeds.feed_id = feed.id and item_feeds.item_id = item.id and feed.id = %d order by item.sqldate desc limit 1;", feed_id ).str );
-        if ( result ) {
-            val = result->FindByNameFirstRow( "sqldate" );
-            if ( val )
-                last_updated = val->getString();
-            val = result->FindByNameFirstRow( "last_updated" );
-            if ( val && last_updated == val->getString() )
-                last_updated = 0; // only bother to update if dates differ
-        }
+        fetchJob_t * job = engine.add( val->getString(), id ? id->getInt() : 0, &row );
+        if ( (val = row.FindByName( "etag" )) && val->getString() )
+            job->etag = val->getString();
+        if ( (val = row.FindByName( "last_modified" )) && val->getString() )
+            job->last_modified = val->getString();
+    }
 
-        // report how many items directly, as your getting them
-        if ( inserted_this_feed > 0 )
-            printf( "  %d new item%s\n", inserted_this_feed, inserted_this_feed>1?"s":"" );
-        else
-            printf( "\n" );
-        fflush(stdout);
+    pthread_t fetcher;
+    pthread_t * parsers = new pthread_t[ pipe.parsers ];
 
+    if ( pthread_create( &fetcher, 0, update_fetch_thread, &pipe ) )
+        error( "couldn't start fetch thread\n" );
+    for ( unsigned int i = 0; i < pipe.parsers; i++ )
+        if ( pthread_create( &parsers[i], 0, update_parse_thread, &pipe ) )
+            error( "couldn't start parse thread\n" );
 
-        // set last_update to time of most recent post, and fix description if we dont have it and scraped one from the feed
-        if ( (inserted_this_feed > 0 || feed_status == 1) && (description.length() > 0 || last_updated.length() > 0) )
-        {
-            basicString_t fmt;
-            fetch = "update feed set ";
-            if ( description.length() > 0 ) {
-                fetch.append( "description = '" );
-                fetch.append( description );
-            }
-            if ( last_updated.length() > 0 ) {
-                if ( description.length() > 0 )
-                    fetch.append("',");
-                fetch.append( "last_updated = '" );
-                fetch.append( last_updated );
-            }
-            DBA( fetch.append( fmt.sprintf( "' where id = %d;", feed_id ) ).str );
-        }
+    // this thread writes
+    updateWork_t * work;
+    while ( (work = pipe.toWrite.popWait()) ) {
+        update_feed( work->job, state, work->parsed );
+        delete work;
     }
 
+    pthread_join( fetcher, 0 );
+    for ( unsigned int i = 0; i < pipe.parsers; i++ )
+        pthread_join( parsers[i], 0 );
+    delete[] parsers;
+
     // make summary
     fetch = "Got items from:\n";
-    for ( unsigned int i = 0 ; i < updated_feeds.count(); i++ )
-        fetch.append( updated_feeds[i]->str );
-    if ( 0 == feeds_altered )
+    for ( unsigned int i = 0 ; i < state.updated_feeds.count(); i++ )
+        fetch.append( state.updated_feeds[i]->str );
+    if ( 0 == state.feeds_altered )
         matches.sprintf( "no new items found out of %u feed%s queried.", res->numRows(), res->numRows() > 1 ? "s" : "" );
     else
-        matches.sprintf( "%d new item%s found for %d feed%s, out of %u feed%s queried.", total_inserted, total_inserted>1?"s":"", feeds_altered, feeds_altered > 1 ? "s" : "", res->numRows(), res->numRows() > 1 ? "s" : "" );
+        matches.sprintf( "%d new item%s found for %d feed%s, out of %u feed%s queried.", state.total_inserted, state.total_inserted>1?"s":"", state.feeds_altered, state.feeds_altered > 1 ? "s" : "", res->numRows(), res->numRows() > 1 ? "s" : "" );
     fetch += matches;
 
     long long int sec = timer.delta();
     long long int min = sec / 60;
     sec %= 60;
-    fetch += matches.sprintf( " Update took %ld:%02ld\n", min, sec );
+    fetch.appendf( " Update took %ld:%02ld\n", min, sec );
+    if ( state.bytes_decoded > 0 )
+        fetch.appendf( "Downloaded %lld KB (%lld KB decoded)\n", (state.bytes_wire + 1023) / 1024, (state.bytes_decoded + 1023) / 1024 );
 
 
     // print it
     printf( "%s", fetch.str );
 
+#ifdef _DEBUG
+    if ( known_hashes.lookups )
+        printf( "dedup filter: %lu of %lu items skipped the db, %lu false positive%s (%.2f%%)\n", known_hashes.negatives, known_hashes.lookups, known_hashes.falsePositives, known_hashes.falsePositives == 1 ? "" : "s", 100.0 * known_hashes.falsePositiveRate() );
+#endif
+
     // save report
     remove_reports_over_quota();
     DBA.fixQuotes( fetch );
-    basicString_t& range = translate_unknown_args( ids_inserted.str, "item.id" );
+    basicString_t& range = translate_unknown_args( state.ids_inserted.str, "item.id" );
     DBA( matches.sprintf("insert into reports(update_time,report,item_ids) values ( '%s', '%s','%s');",sqldate_now(),fetch.str,range.str).str );
 } // rss_update
 
@@ -4706,7 +5092,7 @@ static unsigned int _remove_feed( int feed_id )
             // item may be part of another feed, lets check, if not remove it
             DBResult * check = DBA( query.sprintf( "select id from item_feeds where item_id = %d;", item_id ).str );
             if ( !check || check->numRows() == 0 ) {
-                DBA( query.sprintf( "delete from item where id = %d;", item_id ).str );
+                delete_item( item_id );
                 ++items_removed;
             }
         }
@@ -4912,8 +5298,9 @@ static void rss_search_usage( const char * msg =0 )
     turn_off_pager();
     if ( msg )
         printf( "%s\n", msg );
-    printf( "usage: %s search [-o][-f id] [group of terms]\n\n", exename.str );
+    printf( "usage: %s search [-o][-d][-f id] [group of terms]\n\n", exename.str );
     printf( "   -o          changes to an \"OR\" clause instead of \"AND\"\n" );
+    printf( "   -d          newest first, instead of best match first\n" );
     printf( "   -f <range>  limit search to feed(s). Can be expressed as 2,5,7-11\n" );
 }
 
@@ -4926,6 +5313,7 @@ void rss_search()
         return rss_search_usage();
 
     bool OR = cmd_args[0]->icompare( "-o" );
+    bool by_date = !have_search_index; // a scan has nothing to rank by
     basicString_t specific_feeds;
 
     unsigned int match_start = 0;
@@ -4935,6 +5323,10 @@ void rss_search()
             OR = true;
             match_start = i+1;
         }
+        else if ( A == "-d" ) {
+            by_date = true;
+            match_start = i+1;
+        }
         else if ( A == "-f" ) {
             if ( i < cmd_args.count()-1 )
                 specific_feeds = translate_unknown_args( cmd_args[++i]->str );
@@ -4947,15 +5339,31 @@ void rss_search()
 
     basicString_t out;
     basicString_t fmt;
+    basicString_t from;
     basicString_t report;
     for ( unsigned int i = match_start; i < cmd_args.length(); i++ )
     {
-        if ( out.length() )
+        // fts5 only knows its operators in capitals
+        if ( out.length() && have_search_index )
+            out += OR ? " OR " : " AND ";
+        else if ( out.length() )
             out += OR ? " or " : " and ";
-        basicString_t& noquo = *cmd_args[i];
-        DBA.fixQuotes( noquo );
-        const char * m = noquo.str;
-        out += fmt.sprintf( "(item.title like '%%%s%%' or item.description like '%%%s%%' or item.content like '%%%s%%' or item.author like '%%%s%%')", m, m, m, m );
+
+        if ( have_search_index )
+        {
+            // each term a quoted prefix match: "term"*, with its double quotes doubled
+            out += "\"";
+            out += basicString_t( *cmd_args[i] ).replace( "\"", "\"\"" );
+            out += "\"*";
+        }
+        else
+        {
+            basicString_t& noquo = *cmd_args[i];
+            DBA.fixQuotes( noquo );
+            const char * m = noquo.str;
+            out.appendf( "(item.title like '%%%s%%' or item.description like '%%%s%%' or item.content like '%%%s%%' or item.author like '%%%s%%')", m, m, m, m );
+        }
+
         if ( report.length() )
             report += OR ? " or " : " and ";
         report += "\"";
@@ -4982,27 +5390,56 @@ void rss_search()
     }
 
 
-    fmt = "select feed.title as ftitle, feed.id as feed_id, item.* from feed,item,item_feeds where feed.id=item_feeds.feed_id and item.id = item_feeds.item_id and (";
-    fmt += out;
-    if ( specific_feeds.length() ) {
-        fmt += ") and (";
-        fmt += specific_feeds;
+    if ( have_search_index )
+    {
+        DBA.fixQuotes( out );
+        from = " from item_fts,feed,item,item_feeds where item_fts match '";
+        from += out;
+        from += "' and item.id = item_fts.rowid and feed.id=item_feeds.feed_id and item.id = item_feeds.item_id";
+        if ( specific_feeds.length() ) {
+            from += " and (";
+            from += specific_feeds;
+            from += ")";
+        }
+        fmt = "select feed.title as ftitle, feed.id as feed_id, item.*";
+        fmt += from;
+        // title matches count most, then description and author, then content
+        fmt += by_date ? " order by sqldate desc;" : " order by bm25(item_fts, 4.0, 2.0, 1.0, 2.0), sqldate desc;";
+    }
+    else
+    {
+        from = " from feed,item,item_feeds where feed.id=item_feeds.feed_id and item.id = item_feeds.item_id and (";
+        from += out;
+        if ( specific_feeds.length() ) {
+            from += ") and (";
+            from += specific_feeds;
+        }
+        from += ")";
+        fmt = "select feed.title as ftitle, feed.id as feed_id, item.*";
+        fmt += from;
+        fmt += " order by sqldate desc;";
     }
-    fmt += ") order by sqldate desc;";
 
-    DBResult * res = DBA( fmt.str ) ;
+    DBCursor * res = DBA.cursor( fmt.str );
 
-    if ( !res || res->numRows() == 0 ) {
+    if ( !res || !res->next() ) {
+        delete res;
         printf( "found no results matching %s\n", report.str );
         return;
     }
 
+    // the count goes first and numbers the list; it's one query without the rows
+    DBResult * c = DBA( fmt.sprintf( "select count(*) as c%s;", from.str ).str );
+    DBValue * v = c ? c->FindByNameFirstRow( "c" ) : 0;
+    unsigned int total = v ? (unsigned int) v->getInt() : 0;
+
     draw_dashed_line();
-    printf( "Found %u items matching: %s  -- sorting by most recent.\n", res->numRows(), report.str );
+    printf( "Found %u items matching: %s  -- sorting by %s.\n", total, report.str, by_date ? "most recent" : "best match" );
     draw_dashed_line();
     printf( "\n" );
 
-    print_feed_items( res );
+    print_feed_items( res, total );
+    delete res;
 
 } // rss_search
 
@@ -5028,9 +5465,9 @@ int rss_mark( int feed_id, int item_id, const char *_title, const char *iurl, co
     // check for duplicates
     query.sprintf( "select * from saved_links where feed_id = %d and title = '%s' and", feed_id, title.str );
     if ( item_url.length() )
-        query += buf.sprintf( " item_url='%s' and", item_url.str );
+        query.appendf( " item_url='%s' and", item_url.str );
     if ( media_url.length() )
-        query += buf.sprintf( " media_url='%s' and", media_url.str );
+        query.appendf( " media_url='%s' and", media_url.str );
 
     query.strncpy( query.str, query.length()-4 ); // clip trailing and
     query += ';';
@@ -5060,11 +5497,11 @@ int rss_mark( int feed_id, int item_id, const char *_title, const char *iurl, co
 
     if ( item_url.length() ) {
         query += "item_url,";
-        vals += buf.sprintf( "'%s',", item_url.str );
+        vals.appendf( "'%s',", item_url.str );
     }
     if ( media_url.length() ) {
         query += "media_url,";
-        vals += buf.sprintf( "'%s',", media_url.str );
+        vals.appendf( "'%s',", media_url.str );
     }
 
     // clip commas
@@ -5086,13 +5523,12 @@ void rss_pod()
 {
     // scan media_url for podcast types
     const char ** pp = podcast_detection_types;
-    basicString_t buf;
     basicString_t query( "select distinct feed.id,feed.title from feed,item_feeds,item where feed.id = item_feeds.feed_id and item_feeds.item_id = item.id and (" );
     do
     {
         if ( pp != podcast_detection_types )
             query += " or";
-        query += buf.sprintf( " media_url like '%%%s%%'", *pp );
+        query.appendf( " media_url like '%%%s%%'", *pp );
     }
     while ( *++pp );
     query += ") order by feed.id asc;";
@@ -5203,6 +5639,35 @@ void rss_priority()
 }
 
 
+#ifdef _DEBUG
+// for the memPool_t owner mode check in rss_test()
+struct poolCheckObj_t {
+    unsigned int id;
+    unsigned int check;     // ~id while it's out
+};
+
+struct poolReturner_t {
+    memPool_t<poolCheckObj_t> *         pool;
+    boundedQueue_t<poolCheckObj_t*> *   q;
+    unsigned int *                      returned;   // by id
+    unsigned int                        corrupt;
+};
+
+// gives back everything it's handed, from its own thread
+static void * pool_returner( void * arg )
+{
+    poolReturner_t& r = *static_cast<poolReturner_t *>( arg );
+    poolCheckObj_t * o;
+    while ( (o = r.q->popWait()) ) {
+        if ( o->check != ~o->id )
+            ++r.corrupt;
+        __atomic_add_fetch( &r.returned[ o->id ], 1, __ATOMIC_RELAXED );
+        r.pool->returnone( o );
+    }
+    return 0;
+}
+#endif
+
 void rss_test()
 {
 #ifdef _DEBUG
@@ -5233,6 +5698,191 @@ void rss_test()
     printf ("term lines   %d\n", w.ws_row);
     printf ("term columns %d\n", w.ws_col);
 
+    //------------------------------------
+    // indexing every element in turn should cost the same per element,
+    //  however many there are
+    for ( unsigned int n = 25000; n <= 100000; n *= 2 ) {
+        cppbuffer_t<int> buf;
+        for ( unsigned int i = 0; i < n; i++ )
+            buf.push_back( i );
+        utimer_t t;
+        t.set();
+        long long sum = 0;
+        for ( unsigned int i = 0; i < buf.count(); i++ )
+            sum += buf[i];
+        long long us = t.delta();
+        printf( "cppbuffer_t %6u elts: %7lld us, %6.1f ns each (sum %lld)\n", n, us, us * 1000.0 / n, sum );
+    }
+    for ( unsigned int n = 25000; n <= 100000; n *= 2 ) {
+        basicString_t q;
+        q.sprintf( "select x from (with recursive c(x) as (select 1 union all select x+1 from c limit %u) select x from c);", n );
+        DBResult * res = DBA.queryUnsaved( q.str );
+        if ( !res )
+            break;
+        utimer_t t;
+        t.set();
+        long long sum = 0;
+        for ( unsigned int i = 0; i < res->numRows(); i++ )
+            sum += res->getRow(i)[0].getInt();
+        long long us = t.delta();
+        printf( "DBResult    %6u rows: %7lld us, %6.1f ns each (sum %lld)\n", n, us, us * 1000.0 / n, sum );
+        delete res;
+    }
+
+    //------------------------------------
+    // building a 10k item export a piece at a time should only have to
+    //  grow the string a handful of times
+    {
+        utimer_t t;
+        t.set();
+        basicString_t rss( "<?xml version=\"1.0\"?>\n<rss version=\"2.0\"><channel>\n" );
+        unsigned int last = rss.memlen, grows = 0;
+        for ( int i = 0; i < 10000; i++ ) {
+            rss += "<item><title>";
+            rss.appendf( "Item number %d, a title of middling length", i );
+            rss += "</title><link>";
+            rss.appendf( "http://example.com/%d/some-article-slug.html", i );
+            rss += "</link><pubDate>Tue, 09 Apr 2013 12:00:00 GMT</pubDate></item>\n";
+            if ( rss.memlen != last ) {
+                ++grows;
+                last = rss.memlen;
+            }
+        }
+        rss += "</channel></rss>\n";
+        long long us = t.delta();
+        printf( "10k item export: %u bytes, %u reallocations, %lld us\n", rss.length(), grows, us );
+    }
+
+    //------------------------------------
+    // the vector stristr has to agree with the byte at a time one, on
+    //  every length around the block edges, mixed case and high bytes
+    {
+        const char alpha[] = "aAbBzZ@[`{ \xC0\xE0\xFF";
+        srand( 1 );
+        unsigned int cases = 0, bad = 0;
+        char hay[300], needle[40];
+        for ( int n = 0; n < 200000; n++ ) {
+            unsigned int hlen = rand() % 140;
+            unsigned int nlen = 1 + rand() % ( n & 1 ? 4 : 36 );
+            for ( unsigned int i = 0; i < hlen; i++ )
+                hay[i] = alpha[ rand() % ( sizeof(alpha) - 1 ) ];
+            hay[hlen] = 0;
+            if ( hlen >= nlen && rand() % 2 ) {
+                // lift it out of the haystack, flipping case here and there
+                unsigned int at = rand() % ( hlen - nlen + 1 );
+                for ( unsigned int i = 0; i < nlen; i++ ) {
+                    char c = hay[at+i];
+                    needle[i] = ( rand() % 2 && isalpha( c ) ) ? c ^ 0x20 : c;
+                }
+            } else {
+                for ( unsigned int i = 0; i < nlen; i++ )
+                    needle[i] = alpha[ rand() % ( sizeof(alpha) - 1 ) ];
+            }
+            needle[nlen] = 0;
+            ++cases;
+            if ( str_find_nocase( hay, hlen, needle, nlen ) != str_find_nocase_scalar( hay, hlen, needle, nlen ) ) {
+                if ( !bad )
+                    printf( "stristr mismatch: \"%s\" in \"%s\"\n", needle, hay );
+                ++bad;
+            }
+        }
+        printf( "stristr: %u cases, %u mismatches\n", cases, bad );
+    }
+
+    // filtering a big result set: every title checked for a short needle
+    {
+        const char * words[] = { "Linux", "kernel", "Release", "security", "Update", "the", "Of", "NEW", "patch", "driver", 0 };
+        const unsigned int N = 200000;
+        cppbuffer_t<basicString_t> titles;
+        srand( 2 );
+        for ( unsigned int i = 0; i < N; i++ ) {
+            basicString_t t;
+            for ( int w = 0; w < 8; w++ )
+                t.appendf( "%s%s", w ? " " : "", words[ rand() % 10 ] );
+            t.appendf( " %u", i );
+            titles.push_back( t );
+        }
+        const char * find = "DRIVER Pat";
+        unsigned int flen = strlen( find );
+
+        utimer_t t;
+        unsigned int hits_scalar = 0, hits_vec = 0;
+        t.set();
+        for ( unsigned int i = 0; i < N; i++ )
+            hits_scalar += str_find_nocase_scalar( titles[i].str, titles[i].length(), find, flen ) != 0;
+        long long us_scalar = t.delta();
+        t.set();
+        for ( unsigned int i = 0; i < N; i++ )
+            hits_vec += str_find_nocase( titles[i].str, titles[i].length(), find, flen ) != 0;
+        long long us_vec = t.delta();
+        printf( "filter %u titles: scalar %lld us, vector %lld us (%u/%u hits)\n", N, us_scalar, us_vec, hits_scalar, hits_vec );
+    }
+
+    //------------------------------------
+    // memPool_t in owner mode: this thread takes objects out while others
+    //  give them back. Each has to come back exactly once, and afterwards
+    //  the pool must hand out every slot it ever gave, once, before a new one
+    {
+        const unsigned int N = 200000, T = 3;
+        const unsigned int MARK = 0xdeadbeef;
+        memPool_t<poolCheckObj_t> pool( 64 );
+        pool.setOwnerThread();
+
+        unsigned int * returned = new unsigned int[ N ];
+        memset( returned, 0, N * sizeof(unsigned int) );
+        boundedQueue_t<poolCheckObj_t*> q[ T ];
+        poolReturner_t r[ T ];
+        pthread_t th[ T ];
+        for ( unsigned int t = 0; t < T; t++ ) {
+            r[t].pool = &pool;
+            r[t].q = &q[t];
+            r[t].returned = returned;
+            r[t].corrupt = 0;
+            pthread_create( &th[t], 0, pool_returner, &r[t] );
+        }
+
+        for ( unsigned int i = 0; i < N; i++ ) {
+            poolCheckObj_t * o = pool.getone();
+            o->id = i;
+            o->check = ~i;
+            q[ i % T ].pushWait( o );
+        }
+        for ( unsigned int t = 0; t < T; t++ )
+            q[t].pushWait( 0 );
+
+        unsigned int lost = 0, twice = 0, corrupt = 0;
+        for ( unsigned int t = 0; t < T; t++ ) {
+            pthread_join( th[t], 0 );
+            corrupt += r[t].corrupt;
+        }
+        for ( unsigned int i = 0; i < N; i++ ) {
+            lost += returned[i] == 0;
+            twice += returned[i] > 1;
+        }
+        delete[] returned;
+
+        // every slot given out so far is free again
+        unsigned int slots = 0, again = 0;
+        for ( poolPage_t<poolCheckObj_t> * p = pool.page; p; p = p->next ) {
+            slots += p->inuse;
+            if ( p == pool.current )
+                break;
+        }
+        unsigned int pages = pool.numPages;
+        for ( unsigned int i = 0; i < slots; i++ ) {
+            poolCheckObj_t * o = pool.getone();
+            again += o->check == MARK;
+            o->check = MARK;
+        }
+        unsigned int grew = pool.numPages - pages;
+        int inuse = pool.current->inuse;
+        pool.getone();
+        bool fresh = pool.current->inuse == inuse + 1 || pool.numPages != pages + grew;
+
+        printf( "memPool_t: %u returned from %u threads: %u lost, %u twice, %u corrupt\n", N, T, lost, twice, corrupt );
+        printf( "memPool_t: %u slots reused, %u twice, %u new pages, next one %s\n", slots, again, grew, fresh ? "fresh" : "REUSED" );
+    }
+
     //rss_pod();
 
 
@@ -5354,6 +6004,9 @@ int main( int argc, char ** argv )
     // ready to run sub-routine
     run_program_command();
 
+    // keep the dedup filter for next time
+    save_known_hashes();
+
     // In case we're in pager, don't wait to free old query results
     DBA.nukeSavedResults();
 
@@ -28,6 +28,9 @@ along with RSS Power Tool  If not, see <http://www.gnu.org/licenses/>.
 #include <stdio.h>
 #include <stdarg.h>
 #include <string.h>
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
 //#include <SDL/SDL.h>
 
 #include <sys/stat.h>
@@ -196,7 +199,7 @@ const char * strip_path_and_extension( const char * s )
 char * copy_string( const char * s ) 
 {
     if ( !s || !s[0] ) 
-        return '\0';
+        return 0;
     unsigned int len = strlen(s);
     unsigned int bytes = len * sizeof(char) ;
     // checking for null-terminator stops string from growing 1-byte each-time it's copied
@@ -431,35 +434,93 @@ void dirlist_t::sort_alphabetical( void )
 // basicString_t 
 //
 
-#define APPEND_MIN_ALLOC_SZ 32
-
 basicString_t::basicString_t( const char * A ) : str(0), len(0), memlen(0) {
     if ( !A || !*A )
         return;
     unsigned int _len = strlen( A );
     if ( _len > 0 ) {
+        newMem( _len + 1 );
         len = _len;
-        memlen = len + 1;
-        str = new char[ memlen ];
-        ::strncpy( str, A, len );
+        memcpy( str, A, len );
         str[len] = 0;
     }
 }
 
 basicString_t::basicString_t( const basicString_t& t ) : str(0), len(0), memlen(0) {
     if ( t.str ) {
-        len = t.len;
 #ifdef _DEBUG
         unsigned int _len = strlen( t.str );
-        Assert( _len == len );
+        Assert( _len == t.len );
 #endif
-        memlen = len + 1;
-        str = new char[ memlen ];
-        ::strncpy( str, t.str, len );
+        newMem( t.len + 1 );
+        len = t.len;
+        memcpy( str, t.str, len );
         str[len] = 0;
     }
 }
 
+basicString_t& basicString_t::operator=( basicString_t&& t )
+{
+    if ( this != &t ) {
+        if ( onHeap() )
+            delete[] str;
+        str = 0;
+        len = memlen = 0;
+        take( t );
+    }
+    return *this;
+}
+
+void basicString_t::take( basicString_t& t )
+{
+    if ( t.onHeap() ) {
+        str = t.str;
+        memlen = t.memlen;
+    } else if ( t.str ) {
+        str = inl;
+        memlen = BASICSTRING_INLINE_SZ;
+        memcpy( inl, t.str, t.len + 1 );
+    }
+    len = t.len;
+
+    t.str = 0;
+    t.len = t.memlen = 0;
+}
+
+void basicString_t::newMem( unsigned int n )
+{
+    if ( str && n <= memlen )
+        return;
+    if ( onHeap() )
+        delete[] str;
+    if ( n <= BASICSTRING_INLINE_SZ ) {
+        str = inl;
+        memlen = BASICSTRING_INLINE_SZ;
+    } else {
+        str = new char[ n ];
+        memlen = n;
+    }
+}
+
+void basicString_t::growMem( unsigned int n )
+{
+    if ( str && n <= memlen )
+        return;
+
+    char * mem = n <= BASICSTRING_INLINE_SZ ? inl : new char[ n ];
+    unsigned int sz = n <= BASICSTRING_INLINE_SZ ? BASICSTRING_INLINE_SZ : n;
+
+    // only an unset string can still fit inline, so there's nothing to keep
+    memset( mem, 0, sz );
+    if ( str ) {
+        memcpy( mem, str, len );
+        if ( onHeap() )
+            delete[] str;
+    }
+    str = mem;
+    memlen = sz;
+}
+
 basicString_t& basicString_t::set( const char * A ) 
 {
     if ( !A || !*A ) 
@@ -469,18 +530,12 @@ basicString_t& basicString_t::set( const char * A )
     } 
     else 
     {
-        len = strlen( A );
-
-        if ( len >= memlen && str ) {
-            delete[] str;
-            memlen = len + 1;
-            str = new char[ memlen ];
-        } 
-        else if ( !str ) {
-            str = new char[len+1];
-            memlen = len + 1;
-        }
-        ::strncpy( str, A, memlen );
+        // A may be in str, in which case it's shorter and no memory is needed
+        unsigned int _len = strlen( A );
+        if ( _len >= memlen || !str )
+            newMem( _len + 1 );
+        memmove( str, A, _len );
+        len = _len;
         str[len] = 0;
     }
     return *this;
@@ -513,29 +568,12 @@ basicString_t& basicString_t::strncpy( const char *newstr, unsigned int newlen )
         erase();
         return *this;
     } 
-    else if ( !str )
-    {
-        str = new char[newlen+1];
-        len = newlen;
-        memlen = newlen + 1;
-        ::strncpy( str, newstr, newlen );
-        str[newlen] = 0;
-    }
-    else if ( newlen >= memlen ) 
-    {
-        delete[] str;
-        str = new char[newlen+1];
-        memlen = newlen + 1;
-        len = newlen;
-        ::strncpy( str, newstr, newlen );
-        str[newlen] = 0;
-    } 
-    else 
-    {
-        len = newlen;
-        ::strncpy( str, newstr, newlen );
-        str[newlen] = 0;
-    }
+
+    if ( !str || newlen >= memlen ) 
+        newMem( newlen + 1 );
+    len = newlen;
+    ::strncpy( str, newstr, newlen );
+    str[newlen] = 0;
     return *this;
 }
 
@@ -545,20 +583,13 @@ basicString_t& basicString_t::strncpy( const char *newstr, unsigned int newlen )
 char& basicString_t::operator[]( unsigned int index ) 
 {
     if ( !str ) {
-        str = new char[index+1];        
-        memlen = index + 1;
+        growMem( index + 1 );
         len = index;
-        memset( str, 0, sizeof(char) * memlen );
     } 
     // accessing outside of memlen doesn't increase string length
     else if ( index >= memlen ) 
     { 
-        memlen = index + 1;
-        char * newstr = new char[ memlen ];
-        memset( newstr, 0, sizeof(char)*memlen );
-        ::strncpy( newstr, str, len );
-        delete[] str;
-        str = newstr;
+        growMem( index + 1 );
     }
     // FIXME: note that accessing an index > len, doesn't set len 
     return str[index];
@@ -566,26 +597,73 @@ char& basicString_t::operator[]( unsigned int index )
 
 basicString_t& basicString_t::sprintf( const char *fmt, ... )
 {
-    char buf[ _VA_BUF_SZ ];
-    char * buffer = &buf[0];
     va_list argptr;
     va_start( argptr, fmt );
-    int len_actual = vsnprintf( buffer, sizeof( buf ), fmt, argptr );
+    vformat( 0, fmt, argptr );
     va_end( argptr );
+    return *this;
+}
 
-    if ( len_actual >= _VA_BUF_SZ )
-    {
-        buffer = (char*) malloc( len_actual+1 );
-        va_start( argptr, fmt );
-        vsnprintf( buffer, len_actual+1, fmt, argptr );
-        va_end( argptr );
-        set( buffer );
-        free( buffer );
+basicString_t& basicString_t::appendf( const char *fmt, ... )
+{
+    va_list argptr;
+    va_start( argptr, fmt );
+    vformat( len, fmt, argptr );
+    va_end( argptr );
+    return *this;
+}
+
+// one pass when it fits in the memory there is, two when it doesn't
+void basicString_t::vformat( unsigned int at, const char * fmt, va_list ap )
+{
+    if ( !str )
+        newMem( 1 );
+
+    va_list again;
+    va_copy( again, ap );
+
+    int len_actual = vsnprintf( &str[at], memlen - at, fmt, ap );
+    if ( len_actual < 0 ) {
+        len_actual = 0;
+        str[at] = '\0';
     }
-    else
-        set( buffer );
+    else if ( at + len_actual >= memlen ) {
+        len = at;
+        reserve( at + len_actual );
+        vsnprintf( &str[at], memlen - at, fmt, again );
+    }
+    va_end( again );
 
-    return *this;
+    len = at + len_actual;
+}
+
+void basicString_t::reserve( unsigned int n )
+{
+    if ( str && n < memlen )
+        return;
+
+    unsigned int sz = memlen * 2;
+    if ( sz < n + 1 )
+        sz = n + 1;
+
+    // only an unset string has so little
+    if ( sz <= BASICSTRING_INLINE_SZ ) {
+        newMem( sz );
+        len = 0;
+        str[0] = '\0';
+        return;
+    }
+
+    char * mem = new char[ sz ];
+    if ( str ) {
+        memcpy( mem, str, len );
+        if ( onHeap() )
+            delete[] str;
+    } else
+        len = 0;
+    mem[ len ] = '\0';
+    str = mem;
+    memlen = sz;
 }
 
 
@@ -599,35 +677,19 @@ basicString_t& basicString_t::append( const char * app, unsigned int app_len )
         app_len = strlen( app );
     }
 
-    if ( !str )
-    {
-        str = new char[app_len+1];
-        len = app_len;
-        memlen = app_len + 1;
-        ::strncpy( str, app, app_len );
-        str[app_len] = 0;
-    }
-    else if ( len+app_len+1 <= memlen ) // will fit in the memory we already have 
+    if ( !str || len + app_len + 1 > memlen ) 
     {
-        ::strncpy( &str[len], app, app_len );
-        str[ len + app_len ] = 0;
-        len = len + app_len;
-    }
-    else 
-    {
-        // staves off tiny, repeated allocations of 1-byte (which are common in certain applications)
-        // 1-byte allocations can throw nasty errors in various stdlib functions
-        unsigned int alloc_sz = app_len >= APPEND_MIN_ALLOC_SZ ? app_len : APPEND_MIN_ALLOC_SZ;
-
-        char *tmp = new char[len+alloc_sz+1];
-        ::strncpy( tmp, str, len );
-        ::strncpy( &tmp[len], app, app_len );
-        tmp[ len + app_len ] = 0;
-        delete[] str;
-        memlen = len + alloc_sz + 1;
-        len = len + app_len;
-        str = tmp;
+        // app may be part of this string, which is about to move
+        bool inside = str && app >= str && app < str + memlen;
+        unsigned int off = inside ? app - str : 0;
+        reserve( len + app_len );
+        if ( inside )
+            app = str + off;
     }
+
+    memmove( &str[len], app, app_len );
+    len += app_len;
+    str[len] = 0;
     return *this;
 }
 
@@ -654,24 +716,15 @@ basicString_t& basicString_t::operator+= ( const char c )
 }
 basicString_t& basicString_t::operator+= ( const int i )
 {
-    char _buf[32];
-    memset(_buf,0,sizeof(_buf));
-    ::sprintf( _buf, "%i", i );
-    return append( _buf );
+    return appendf( "%i", i );
 }
 basicString_t& basicString_t::operator+= ( const float f )
 {
-    char buf[32];
-    memset(buf,0,sizeof(buf));
-    ::sprintf( buf, "%f", f );
-    return append( buf );
+    return appendf( "%f", f );
 }
 basicString_t& basicString_t::operator+= ( const double d )
 {
-    char buf[32];
-    memset(buf,0,sizeof(buf));
-    ::sprintf( buf, "%lf", d );
-    return append( buf );
+    return appendf( "%lf", d );
 }
 
 
@@ -778,34 +831,20 @@ bool basicString_t::operator!=( const basicString_t& test )
 void basicString_t::setMem( unsigned int newlen )
 {
     if ( newlen == 0 || newlen == 1 ) {
-        if ( str )
-            delete[] str;
-        memlen = len = 0;
+        clearMem();
     }
-    else if ( str )
+    else if ( str && newlen <= len ) // truncate
     {
-        if ( newlen < len ) { // truncate
-            char * _str = new char[ newlen ];
-            ::strncpy( _str, str, newlen-1 );
-            _str[ newlen - 1 ] = '\0';
-            len = newlen - 1;
-            memlen = newlen;
-            delete[] str;
-            str = _str;
-        } else {
-            char * _str = new char[ newlen ];
-            memset( _str, 0, newlen );
-            ::strncpy( _str, str, len );
-            memlen = newlen;
-            delete[] str;
-            str = _str;
-        }
+        len = newlen - 1;
+        str[ len ] = '\0';
+    }
+    else if ( str && newlen <= memlen )
+    {
+        memset( &str[len], 0, memlen - len );
     }
     else
     {
-        str = new char[newlen];
-        memlen = newlen;
-        memset( str, 0, memlen );
+        growMem( newlen );
     }
 }
 
@@ -837,105 +876,208 @@ basicString_t& basicString_t::trim()
         *e = '\0';
     }
 
-    // if beginning of string didn't change we don't need to reallocate
-    if ( p == str )
+    // if beginning of string didn't change, we're done
+    if ( p == str ) {
+        len = e - str;
         return *this; 
+    }
 
-    len = strlen(p);
-    memlen = len + 1;
-    char * str2 = new char[memlen];
-    strcpy( str2, p );
-    delete[] str;
-    str = str2;
+    // shift down over the leading whitespace, in the memory we have
+    len = e - p;
+    memmove( str, p, len + 1 );
     return *this;
 }
 
-const char * basicString_t::strstr( const char * needle ) 
+const char * basicString_t::strstr( strView_t needle ) 
 {
-    if ( !str || !*str || !needle || !*needle )
+    if ( !str || !*str || needle.empty() )
         return 0;
-    return ::strstr( str, needle );
+    return (const char *) memmem( str, strlen( str ), needle.str, needle.len );
 }
 
-const char * basicString_t::strstr( const basicString_t& ref )
+//
+// case-insensitive search, ascii only. The vector versions test the
+//  first and last char of the needle against a whole block of candidate
+//  starts at once, and only compare the middle where both hit
+//
+static inline bool same_nocase( const char * a, const char * b, unsigned int n )
 {
-    return this->strstr( ref.str );
+    for ( unsigned int i = 0; i < n; i++ )
+        if ( char_tolower( a[i] ) != char_tolower( b[i] ) )
+            return false;
+    return true;
 }
 
-// strcasestr is a gnu extension, so we write our own
-const char * basicString_t::stristr( const char * arg )
+const char * str_find_nocase_scalar( const char * hay, unsigned int hlen, const char * needle, unsigned int nlen )
 {
-    if ( !str || !*str ) {
+    if ( !nlen || nlen > hlen )
         return 0;
+
+    // starting char of fragment, and the last place a match can start
+    const char a_start = char_tolower( *needle );
+    const char * last = hay + hlen - nlen;
+
+    for ( const char * s = hay; s <= last; ++s )
+    {
+        if ( char_tolower( *s ) != a_start )
+            continue;
+        if ( same_nocase( s + 1, needle + 1, nlen - 1 ) )
+            return s;
     }
-    else if ( !arg || !*arg )
-        return 0;
+    return 0;
+}
 
-    // length of fragment & haystack
-    const unsigned int alen = strlen( arg );
-    const unsigned int slen = strlen( str );
-    // starting char of fragment
-    int a_start = char_tolower(*arg);
-    // pointer to haystack
-    char * s = const_cast<char *>( str );
+#if defined(__SSE2__)
 
-    unsigned int i;
-    char * p = s;
-    
-    while ( *s && s-str <= slen-alen )
+// 'A'-'Z' get 0x20 or'd in, everything else (incl. >= 0x80, negative here) is left alone
+static inline __m128i fold_16( __m128i c )
+{
+    const __m128i up = _mm_and_si128( _mm_cmpgt_epi8( c, _mm_set1_epi8( 'A' - 1 ) ),
+                                      _mm_cmplt_epi8( c, _mm_set1_epi8( 'Z' + 1 ) ) );
+    return _mm_or_si128( c, _mm_and_si128( up, _mm_set1_epi8( 0x20 ) ) );
+}
+
+// the 16 starts from s on
+static inline const char * block_16( const char * s, const char * needle, unsigned int nlen, __m128i first, __m128i last )
+{
+    const __m128i a = fold_16( _mm_loadu_si128( (const __m128i *) s ) );
+    const __m128i b = fold_16( _mm_loadu_si128( (const __m128i *)( s + nlen - 1 ) ) );
+    unsigned int mask = _mm_movemask_epi8( _mm_and_si128( _mm_cmpeq_epi8( a, first ),
+                                                          _mm_cmpeq_epi8( b, last ) ) );
+    while ( mask )
     {
-        if ( char_tolower(*s) != a_start )
-            ++s;
-        else
-        {
-            p = s;
-            i = 0;
-            char * a = const_cast<char *>( arg );
-            do
-            {
-                if ( char_tolower(*p) == char_tolower(*a) )
-                    ++i;
+        const char * c = s + __builtin_ctz( mask );
+        if ( nlen < 3 || same_nocase( c + 1, needle + 1, nlen - 2 ) )
+            return c;
+        mask &= mask - 1;
+    }
+    return 0;
+}
 
-                if ( i == alen )
-                    return s;
+// candidate starts are [0, starts), and both loads of a block stay inside
+//  hay. The leftover starts get one more block, lined up with the end; the
+//  ones it goes over again were already turned down
+static inline const char * find_nocase_16( const char * hay, unsigned int hlen, const char * needle, unsigned int nlen )
+{
+    const unsigned int starts = hlen - nlen + 1;
+    if ( starts < 16 )
+        return str_find_nocase_scalar( hay, hlen, needle, nlen );
 
-                ++p; ++a;
-            } 
-            while( *p && *a );
+    const __m128i first = _mm_set1_epi8( char_tolower( needle[0] ) );
+    const __m128i last = _mm_set1_epi8( char_tolower( needle[nlen-1] ) );
 
-            if ( i == alen )
-                return s;
-            ++s;
-        }
+    unsigned int i = 0;
+    for ( ; i + 16 <= starts; i += 16 )
+        if ( const char * r = block_16( hay + i, needle, nlen, first, last ) )
+            return r;
+    if ( i < starts )
+        return block_16( hay + starts - 16, needle, nlen, first, last );
+    return 0;
+}
+
+static const char * str_find_nocase_sse2( const char * hay, unsigned int hlen, const char * needle, unsigned int nlen )
+{
+    if ( !nlen || nlen > hlen )
+        return 0;
+    return find_nocase_16( hay, hlen, needle, nlen );
+}
+
+__attribute__((target("avx2")))
+static inline __m256i fold_32( __m256i c )
+{
+    const __m256i up = _mm256_and_si256( _mm256_cmpgt_epi8( c, _mm256_set1_epi8( 'A' - 1 ) ),
+                                         _mm256_cmpgt_epi8( _mm256_set1_epi8( 'Z' + 1 ), c ) );
+    return _mm256_or_si256( c, _mm256_and_si256( up, _mm256_set1_epi8( 0x20 ) ) );
+}
+
+__attribute__((target("avx2")))
+static inline const char * block_32( const char * s, const char * needle, unsigned int nlen, __m256i first, __m256i last )
+{
+    const __m256i a = fold_32( _mm256_loadu_si256( (const __m256i *) s ) );
+    const __m256i b = fold_32( _mm256_loadu_si256( (const __m256i *)( s + nlen - 1 ) ) );
+    unsigned int mask = _mm256_movemask_epi8( _mm256_and_si256( _mm256_cmpeq_epi8( a, first ),
+                                                                _mm256_cmpeq_epi8( b, last ) ) );
+    while ( mask )
+    {
+        const char * c = s + __builtin_ctz( mask );
+        if ( nlen < 3 || same_nocase( c + 1, needle + 1, nlen - 2 ) )
+            return c;
+        mask &= mask - 1;
     }
     return 0;
 }
 
-// alias
-const char * basicString_t::strcasestr( const char * arg )
+__attribute__((target("avx2")))
+static const char * str_find_nocase_avx2( const char * hay, unsigned int hlen, const char * needle, unsigned int nlen )
 {
-    return this->stristr( arg );
+    if ( !nlen || nlen > hlen )
+        return 0;
+
+    // short ones take the 16 wide path, built inline here so it stays vex encoded
+    const unsigned int starts = hlen - nlen + 1;
+    if ( starts < 32 )
+        return find_nocase_16( hay, hlen, needle, nlen );
+
+    const __m256i first = _mm256_set1_epi8( char_tolower( needle[0] ) );
+    const __m256i last = _mm256_set1_epi8( char_tolower( needle[nlen-1] ) );
+
+    unsigned int i = 0;
+    for ( ; i + 32 <= starts; i += 32 )
+        if ( const char * r = block_32( hay + i, needle, nlen, first, last ) )
+            return r;
+    if ( i < starts )
+        return block_32( hay + starts - 32, needle, nlen, first, last );
+    return 0;
 }
 
-const char * basicString_t::stristr( const basicString_t& ref )
+#endif
+
+typedef const char * (*findNoCase_f)( const char *, unsigned int, const char *, unsigned int );
+
+static findNoCase_f pick_find_nocase()
 {
-    return this->stristr( ref.str );
-} 
+#if defined(__SSE2__)
+    __builtin_cpu_init();
+    if ( __builtin_cpu_supports( "avx2" ) )
+        return str_find_nocase_avx2;
+    return str_find_nocase_sse2;
+#else
+    return str_find_nocase_scalar;
+#endif
+}
 
-const char * basicString_t::strcasestr( const basicString_t& ref )
+const char * str_find_nocase( const char * hay, unsigned int hlen, const char * needle, unsigned int nlen )
 {
-    return this->stristr( ref.str );
-} 
+    // picked once, on first use
+    static const findNoCase_f find = pick_find_nocase();
+    return find( hay, hlen, needle, nlen );
+}
+
+// strcasestr is a gnu extension, so we write our own
+const char * basicString_t::stristr( strView_t arg )
+{
+    if ( !str || !*str || arg.empty() )
+        return 0;
+
+    // length of haystack; counted, since writes through operator[] don't keep len
+    return str_find_nocase( str, strlen( str ), arg.str, arg.len );
+}
+
+// alias
+const char * basicString_t::strcasestr( strView_t arg )
+{
+    return this->stristr( arg );
+}
 
 
-basicString_t basicString_t::operator+( const char * c_str )
+basicString_t basicString_t::operator+( const char * c_str ) const &
 {
     basicString_t internal( this->str );
     internal.append( c_str );
     return internal; // temporary object
 }
 
-basicString_t basicString_t::operator+( const basicString_t & ref )
+basicString_t basicString_t::operator+( const basicString_t & ref ) const &
 {
     basicString_t internal( str );
     internal.append( ref );
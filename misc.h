@@ -25,6 +25,8 @@ along with RSS Power Tool  If not, see <http://www.gnu.org/licenses/>.
 #ifndef __MISC_H__
 #define __MISC_H__
 
+#include <stdarg.h>
+
 #include "datastruct.h"
 
 #define _VA_BUF_SZ 8192
@@ -68,19 +70,69 @@ inline void str_replace( const char s, const char r, char * q )
 }
 
 class basicArray_t;
+struct basicString_t;
+
+/////////////////////////////////////////////////////////////////////////////
+//
+//  strView_t
+//
+//  - a pointer and a length, borrowed for a read-only argument. Nothing is
+//    copied, and when it's made from a basicString_t the length is already
+//    known, so nothing is counted either. Not always null-terminated
+//
+struct strView_t
+{
+    const char *    str;
+    unsigned int    len;
+
+    strView_t() : str(0), len(0)
+    { }
+    strView_t( const char * s ) : str(s), len( s ? strlen(s) : 0 )
+    { }
+    strView_t( const char * s, unsigned int n ) : str(s), len(n)
+    { }
+    inline strView_t( const basicString_t& );
+
+    bool empty() const { return !str || !len; }
+};
 
 /////////////////////////////////////////////////////////////////////////////
 //
 //  basicString_t
 //
+
+// strings shorter than this are kept in the object itself; dates, ids and
+//  column names mostly are
+#define BASICSTRING_INLINE_SZ 24
+
 struct basicString_t
 {
-    char *          str;
+    char *          str;        // 0 when unset, else inl or the heap
 
     unsigned int    len;        // current strlen
     unsigned int    memlen;     // length of memory in bytes; 
                                 // -these will differ if overwritten with shorter string
 
+protected:
+    char            inl[ BASICSTRING_INLINE_SZ ];
+
+    bool onHeap() const { return str && str != inl; }
+
+    // at least n bytes, to overwrite; the old contents are let go
+    void newMem( unsigned int n );
+
+    // at least n bytes, keeping the old contents and zeroing the rest
+    void growMem( unsigned int n );
+
+    // printf formatted, from position at on; what was there is overwritten
+    void vformat( unsigned int at, const char * fmt, va_list ap );
+
+    // moves t's string here, leaving t empty. The heap memory changes
+    //  hands; an inline string is copied
+    void take( basicString_t& t );
+
+public:
+
     basicString_t() : str(0), len(0), memlen(0)
     { }
 
@@ -93,13 +145,17 @@ struct basicString_t
     //  will provide one that copies the pointer
     basicString_t& operator=( const basicString_t& t );
 
+    // temporaries hand over what they have
+    basicString_t( basicString_t&& t ) : str(0), len(0), memlen(0) { take( t ); }
+    basicString_t& operator=( basicString_t&& t );
+
     virtual ~basicString_t() { 
-        if (str) 
+        if ( onHeap() ) 
             delete[] str; 
     }
     
     void clearMem() {
-        if (str) 
+        if ( onHeap() ) 
             delete[] str; 
         str = 0;
         memlen = len = 0;
@@ -115,6 +171,11 @@ struct basicString_t
     // pre-allocate or explicitly set the internal memory; will truncate string if 
     //  new value is less than len, otherwise, will pad with \0
     void setMem( unsigned int ) ;
+
+    // room for a string of at least n chars, without changing this one.
+    //  Grows to at least twice what it had, so strings built up a piece
+    //  at a time only reallocate a handful of times
+    void reserve( unsigned int n );
    
 
     virtual basicString_t& set( const char * );
@@ -126,14 +187,18 @@ struct basicString_t
     virtual void Print( const char * =0 );
 
     basicString_t& strncpy( const char *, unsigned int );
+
+    // formatted straight into the string's own memory. The arguments
+    //  mustn't point into it
     basicString_t& sprintf( const char *, ... );
+    basicString_t& appendf( const char *, ... );
 
     char& operator[]( unsigned int );
     char& operator[]( int w ) { return (*this)[ (unsigned int)w ]; }
     char& operator[]( long int w ) { return (*this)[ (unsigned int)w ]; }
 
-    basicString_t& toLower() { str_tolower(str); return *this; }
-    basicString_t& toUpper() { str_toupper(str); return *this; }
+    basicString_t& toLower() { if ( str ) str_tolower(str); return *this; }
+    basicString_t& toUpper() { if ( str ) str_toupper(str); return *this; }
     unsigned int length() const { return len; }
 
     basicString_t& append( const char *, unsigned int =0 );
@@ -157,15 +222,15 @@ struct basicString_t
 
     basicString_t& trim();
 
-    const char * strstr( const char * );
-    const char * stristr( const char * );
-    const char * strcasestr( const char * ); // alias
-    const char * strstr( const basicString_t& );
-    const char * stristr( const basicString_t& );
-    const char * strcasestr( const basicString_t& ); // alias
+    const char * strstr( strView_t );
+    const char * stristr( strView_t );
+    const char * strcasestr( strView_t ); // alias
 
-    basicString_t operator+( const char * );
-    basicString_t operator+( const basicString_t& );
+    basicString_t operator+( const char * ) const &;
+    basicString_t operator+( const basicString_t& ) const &;
+    // a temporary's memory is reused, so a + b + c copies a only once
+    basicString_t operator+( const char * c ) && { append( c ); return static_cast<basicString_t&&>( *this ); }
+    basicString_t operator+( const basicString_t& b ) && { append( b ); return static_cast<basicString_t&&>( *this ); }
 
     basicString_t substr( unsigned int, unsigned int );
 
@@ -203,6 +268,9 @@ struct basicString_t
     // - basicString_t::append( float ); // double-ditto
 
 };
+
+inline strView_t::strView_t( const basicString_t& s ) : str( s.str ), len( s.len )
+{ }
 //
 /////////////////////////////////////////////////////////////////////////////
 
@@ -258,6 +326,12 @@ public:
 const char * strspn_p( const char * haystack, const char * whitelist );
 const char * strcspn_p( const char * haystack, const char * whitelist );
 
+// case-insensitive (ascii) search for needle in the first hlen bytes of hay,
+//  0 if not there. Uses SSE2 or AVX2, whichever the cpu has
+const char * str_find_nocase( const char * hay, unsigned int hlen, const char * needle, unsigned int nlen );
+// byte at a time; what the vector versions are checked against
+const char * str_find_nocase_scalar( const char * hay, unsigned int hlen, const char * needle, unsigned int nlen );
+
 inline int is64() {
     return sizeof(void*) == 8;
 }
@@ -348,7 +348,7 @@ const char * SHA1_BlockSumPrintable( const void * data, unsigned int length )
     SHA1_Update(&context, (const byte *)data, length );
     SHA1_Final(digest, &context);
 
-    static char display[41];
+    static __thread char display[41]; // per thread; hashing runs on the update parse pool
     memset( display, 0, sizeof(char)*41 );
     for ( int i = 0; i < 20; i++ ) {
         sprintf( &display[i*2], "%02x", digest[i] & 0xFF );